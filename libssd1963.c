@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2013, Franz Brauße
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+#include "libssd1963.h"
+
+#define GPIOMEM_DEV	"/dev/gpiomem"
+#define DRIVER_SYSFS	"/sys/bus/platform/drivers/" SSD1963_FB_DRIVER_NAME
+
+#ifdef SSD1963_LIB_SIM
+#define SSD_GPIO_RD(reg)		ssd1963_sim_rd(reg)
+#define SSD_GPIO_WR(reg, v)		ssd1963_sim_wr(reg, v)
+#define SSD_GPIO_WR_RELAXED(reg, v)	ssd1963_sim_wr(reg, v)
+#define SSD_BUS_DELAY(n)		do {} while (0)
+#else
+static volatile u32 *gpio;
+
+static void nop_n(unsigned n)
+{
+	while (n--)
+		__asm__ __volatile__ ("nop");
+}
+
+#define SSD_GPIO_RD(reg)		(gpio[(reg) / 4])
+#define SSD_GPIO_WR(reg, v) \
+	do { __sync_synchronize(); gpio[(reg) / 4] = (v); } while (0)
+#define SSD_GPIO_WR_RELAXED(reg, v)	(gpio[(reg) / 4] = (v))
+#define SSD_BUS_DELAY(n)		nop_n(n)
+#endif
+
+#include "ssd1963_bus.h"
+
+static struct ssd1963_lib {
+	const struct ssd1963_platform_data *pdata;
+	struct ssd_bus bus;
+	struct ssd_px_state px;
+	unsigned (*px_enc)(const struct ssd_bus *bus, struct ssd_px_state *st,
+			   u32 *w, u32 color);
+	struct ssd_init_vector iv;
+	int lock_fd;
+	u32 *prev;                 /* last frame sent by ssd1963_flush() */
+	int prev_valid;
+} this_lib = { .lock_fd = -1 };
+
+void ssd_wr_slow_data(u8 v)
+{
+	ssd_bus_wr_slow_data(&this_lib.bus, v);
+}
+
+void ssd_wr_slow_cmd(u8 v)
+{
+	ssd_bus_wr_slow_cmd(&this_lib.bus, v);
+}
+
+int ssd_rd_slow_data(void)
+{
+	return ssd_bus_rd_slow(&this_lib.bus);
+}
+
+static inline void ssd1963_wr_data(u8 x)
+{
+	ssd_bus_wr0(&this_lib.bus, ssd_bus_enc(&this_lib.bus, x));
+}
+
+#define SSD_WR_CMD(x)	ssd_wr_slow_cmd(x)
+#define SSD_WR_DATA(x)	ssd1963_wr_data(x)
+
+#include "ssd1963_cmd.h"
+
+/* switches all of the bus' pins to outputs or back to inputs */
+static void ssd1963_pins_dir(int out)
+{
+	const struct ssd1963_platform_data *pdata = this_lib.pdata;
+	unsigned i, pin;
+	u32 r;
+
+	for (i = 0; i < pdata->bus_width + 3; i++) {
+		pin = i < pdata->bus_width ? pdata->data_pins[i]
+		    : i == pdata->bus_width ? pdata->dc_pin
+		    : i == pdata->bus_width + 1 ? pdata->wr_pin
+		    : pdata->rd_pin;
+		if (pin == SSD1963_PIN_NONE)
+			continue;
+		r = SSD_GPIO_RD(SSD_GPIO_FSEL(pin / 10));
+		r &= ~(7 << (pin % 10 * 3));
+		if (out)
+			r |= 1 << (pin % 10 * 3);
+		SSD_GPIO_WR(SSD_GPIO_FSEL(pin / 10), r);
+	}
+}
+
+/* whether the kernel driver is bound to a device, which then owns the bus */
+static int ssd1963_kernel_bound(void)
+{
+	static const char *const attrs[] = {
+		".", "..", "bind", "unbind", "uevent", "module",
+	};
+	struct dirent *e;
+	unsigned i;
+	int bound = 0;
+	DIR *d;
+
+	d = opendir(DRIVER_SYSFS);
+	if (!d)
+		return 0;
+	while (!bound && (e = readdir(d))) {
+		for (i = 0; i < ARRAY_SIZE(attrs); i++)
+			if (!strcmp(e->d_name, attrs[i]))
+				break;
+		bound = i == ARRAY_SIZE(attrs);
+	}
+	closedir(d);
+	return bound;
+}
+
+#ifndef SSD1963_LIB_SIM
+static int ssd1963_map_gpio(void)
+{
+	void *p;
+	int fd;
+
+	fd = open(GPIOMEM_DEV, O_RDWR | O_SYNC | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	p = mmap(NULL, SSD_GPIO_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+		 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return -errno;
+	gpio = p;
+	return 0;
+}
+#endif
+
+int ssd1963_open(const struct ssd1963_platform_data *pdata)
+{
+	unsigned pin;
+	int ret;
+
+	if (this_lib.pdata)
+		return -EBUSY;
+
+	ret = ssd_bus_setup(&this_lib.bus, pdata, &pin);
+	if (ret) {
+		if (pin == SSD1963_PIN_NONE)
+			printk(SSD_LOG_NAME ": interface format %d needs %u "
+			       "data lines, only %u are connected\n",
+			       pdata->bus_fmt, ssd_bus_fmt_width(pdata->bus_fmt),
+			       pdata->bus_width);
+		else
+			printk(SSD_LOG_NAME ": invalid or duplicate bus pin "
+			       "%u\n", pin);
+		return ret;
+	}
+
+	this_lib.lock_fd = open(SSD1963_LIB_LOCK, O_RDWR | O_CREAT | O_CLOEXEC,
+				0644);
+	if (this_lib.lock_fd < 0) {
+		ret = -errno;
+		goto fail;
+	}
+	if (flock(this_lib.lock_fd, LOCK_EX | LOCK_NB)) {
+		ret = errno == EWOULDBLOCK ? -EBUSY : -errno;
+		goto close_lock;
+	}
+	if (ssd1963_kernel_bound()) {
+		printk(SSD_LOG_NAME ": the bus is owned by the kernel driver, "
+		       "unbind it via " DRIVER_SYSFS "/unbind first\n");
+		ret = -EBUSY;
+		goto close_lock;
+	}
+
+#ifdef SSD1963_LIB_SIM
+	ssd1963_sim_attach(pdata);
+#else
+	ret = ssd1963_map_gpio();
+	if (ret)
+		goto close_lock;
+#endif
+
+	switch (pdata->bus_fmt) {
+	case SSD_DATA_8:         this_lib.px_enc = ssd_px_enc8; break;
+	case SSD_DATA_9:         this_lib.px_enc = ssd_px_enc9; break;
+	case SSD_DATA_12:        this_lib.px_enc = ssd_px_enc12; break;
+	case SSD_DATA_16_PACKED: this_lib.px_enc = ssd_px_enc16_packed; break;
+	case SSD_DATA_16_565:
+	case SSD_DATA_18:
+	case SSD_DATA_24:        this_lib.px_enc = ssd_px_enc1; break;
+	}
+
+	/* idle levels first: control lines inactive, 0 (SSD_NOP) on data */
+	this_lib.pdata = pdata;
+	SSD_GPIO_WR(SSD_GPIO_SET0, this_lib.bus.dc_mask | this_lib.bus.wr_mask |
+				   this_lib.bus.rd_mask);
+	SSD_GPIO_WR(SSD_GPIO_CLR0, this_lib.bus.data_mask);
+	ssd1963_pins_dir(1);
+	return 0;
+
+close_lock:
+	close(this_lib.lock_fd);
+	this_lib.lock_fd = -1;
+fail:
+	printk(SSD_LOG_NAME ": open failed, err %d\n", ret);
+	return ret;
+}
+
+void ssd1963_close(void)
+{
+	if (!this_lib.pdata)
+		return;
+
+	ssd1963_pins_dir(0);
+#ifndef SSD1963_LIB_SIM
+	munmap((void *)gpio, SSD_GPIO_SIZE);
+	gpio = NULL;
+#endif
+	free(this_lib.prev);
+	this_lib.prev = NULL;
+	this_lib.prev_valid = 0;
+	close(this_lib.lock_fd);
+	this_lib.lock_fd = -1;
+	this_lib.pdata = NULL;
+}
+
+int ssd1963_init(unsigned refresh_rate)
+{
+	const struct ssd1963_platform_data *pdata = this_lib.pdata;
+	struct ssd_init_vector *iv = &this_lib.iv;
+	enum ssd_err err;
+
+	err = ssd_iv_init(iv, pdata->xtal_freq, pdata->pll_m, pdata->pll_n,
+			  pdata->pll_as_sysclk, &pdata->lcd, refresh_rate);
+	if (!err)
+		err = ssd_init_pll(iv);
+	if (err == SSD_ERR_PLL_UNSTABLE)
+		SSD_SET_PLL(0x00);
+	if (!err) {
+		SSD_SET_PIXEL_DATA_INTERFACE(pdata->bus_fmt);
+		err = ssd_init_display(iv);
+	}
+	if (err) {
+		printk(SSD_LOG_NAME ": init: %s\n", ssd_strerr(err));
+		return -EIO;
+	}
+
+	/* don't show what GRAM held before */
+	SSD_SET_DISPLAY_OFF();
+	SSD_SET_ADDRESS_MODE(pdata->lcd_addr_mode);
+	ssd1963_fill(0, 0, iv->hdp, iv->vdp, 0);
+	SSD_SET_DISPLAY_ON();
+	this_lib.prev_valid = 0;
+	return 0;
+}
+
+void ssd1963_set_address_mode(u8 mode)
+{
+	SSD_SET_ADDRESS_MODE(mode);
+	this_lib.prev_valid = 0;
+}
+
+u32 ssd1963_rgb(u8 r, u8 g, u8 b)
+{
+	switch (this_lib.pdata->bus_fmt) {
+	case SSD_DATA_16_565:
+		return (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+	case SSD_DATA_9:
+	case SSD_DATA_18:
+		return (r >> 2) << 12 | (g >> 2) << 6 | b >> 2;
+	default:
+		return r << 16 | g << 8 | b;
+	}
+}
+
+void ssd1963_window(u16 x, u16 y, u16 w, u16 h)
+{
+	SSD_SET_PAGE_ADDRESS(y, y + h - 1);
+	SSD_SET_COLUMN_ADDRESS(x, x + w - 1);
+	SSD_WRITE_MEMORY_START();
+	this_lib.px.color1_valid = 0;
+}
+
+void ssd1963_px(u32 color)
+{
+	u32 w[SSD_PX_MAX_WORDS];
+
+	ssd_bus_wr_words(&this_lib.bus, w,
+			 this_lib.px_enc(&this_lib.bus, &this_lib.px, w, color));
+}
+
+void ssd1963_px_end(void)
+{
+	u32 w[1];
+
+	ssd_bus_wr_words(&this_lib.bus, w,
+			 ssd_px_enc_flush(&this_lib.bus, &this_lib.px, w));
+}
+
+/* Sends n pixels of the same color. If a pixel is encoded into identical
+ * words, all but the first word are just #WR strobes. */
+static void ssd1963_px_rep(u32 color, u32 n)
+{
+	const struct ssd_bus *bus = &this_lib.bus;
+	u32 w[SSD_PX_MAX_WORDS];
+	unsigned k, i;
+
+	if (!n)
+		return;
+	if (this_lib.pdata->bus_fmt == SSD_DATA_16_PACKED) {
+		while (n--)
+			ssd1963_px(color);
+		return;
+	}
+
+	k = this_lib.px_enc(bus, &this_lib.px, w, color);
+	for (i = 1; i < k && w[i] == w[0]; i++);
+	if (i < k) {
+		while (n--)
+			ssd_bus_wr_words(bus, w, k);
+		return;
+	}
+
+	ssd_bus_wr0(bus, w[0]);
+	for (n = n * k - 1; n; n--)
+		ssd_bus_strobe(bus);
+}
+
+void ssd1963_fill(u16 x, u16 y, u16 w, u16 h, u32 color)
+{
+	if (!w || !h)
+		return;
+	ssd1963_window(x, y, w, h);
+	ssd1963_px_rep(color, (u32)w * h);
+	ssd1963_px_end();
+}
+
+void ssd1963_blit(u16 x, u16 y, u16 w, u16 h, const u32 *px, unsigned stride)
+{
+	u32 c = 0, n = 0, i;
+
+	if (!w || !h)
+		return;
+	ssd1963_window(x, y, w, h);
+	for (; h; h--, px += stride) {
+		for (i = 0; i < w; i++) {
+			if (n && px[i] == c) {
+				n++;
+				continue;
+			}
+			ssd1963_px_rep(c, n);
+			c = px[i];
+			n = 1;
+		}
+	}
+	ssd1963_px_rep(c, n);
+	ssd1963_px_end();
+}
+
+unsigned ssd1963_flush(const u32 *frame, unsigned stride)
+{
+	unsigned w = this_lib.iv.hdp, h = this_lib.iv.vdp, y, y0, n = 0;
+	size_t ll = w * sizeof(u32);
+	u32 *prev;
+
+	if (!this_lib.prev) {
+		this_lib.prev = malloc(ll * h);
+		this_lib.prev_valid = 0;
+	}
+	prev = this_lib.prev;
+	if (!prev) {
+		ssd1963_blit(0, 0, w, h, frame, stride);
+		return h;
+	}
+
+	for (y = 0; y < h; ) {
+		if (this_lib.prev_valid &&
+		    !memcmp(prev + y * w, frame + y * stride, ll)) {
+			y++;
+			continue;
+		}
+		/* a run of changed lines */
+		for (y0 = y; y < h; y++) {
+			if (this_lib.prev_valid &&
+			    !memcmp(prev + y * w, frame + y * stride, ll))
+				break;
+			memcpy(prev + y * w, frame + y * stride, ll);
+		}
+		ssd1963_blit(0, y0, w, y - y0, frame + y0 * stride, stride);
+		n += y - y0;
+	}
+	this_lib.prev_valid = 1;
+	return n;
+}
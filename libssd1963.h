@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2013, Franz Brauße
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBSSD1963_H
+#define LIBSSD1963_H
+
+/* Drives the SSD1963 from userspace with the kernel driver's controller and
+ * bus code, for clients which can't afford the syscalls and the fb layer. The
+ * GPIO block is mapped from /dev/gpiomem; built with SSD1963_LIB_SIM a
+ * simulated controller decoding the bus traffic into an image is driven
+ * instead.
+ *
+ * The bus is a single global resource, as in the kernel driver: the functions
+ * are not thread safe and only one process at a time may hold the bus, see
+ * ssd1963_open(). Coordinates are in panel pixels, colors in the layout of
+ * the interface format (see ssd1963_rgb()). */
+
+#include "ssd1963_fb.h"
+
+/* taken with flock() by ssd1963_open() */
+#ifndef SSD1963_LIB_LOCK
+#define SSD1963_LIB_LOCK	"/run/lock/libssd1963.lock"
+#endif
+
+/* Takes the lock, fails with -EBUSY if another process holds it or the
+ * kernel driver is bound to a device, maps the GPIO block and drives the bus'
+ * pins. Returns 0 or a negative errno value. */
+int ssd1963_open(const struct ssd1963_platform_data *pdata);
+
+/* releases the pins (as inputs) and the lock, the controller keeps running */
+void ssd1963_close(void);
+
+/* Starts the PLL, programs the panel's timings for refresh_rate (0 for the
+ * panel's typical pixel clock), clears GRAM and turns the display on. Returns
+ * 0 or a negative errno value. */
+int ssd1963_init(unsigned refresh_rate);
+
+/* sets the address mode (SSD_ADDR_*), e.g. for mirrored panels */
+void ssd1963_set_address_mode(u8 mode);
+
+/* converts 8 bit per channel RGB to the interface format */
+u32 ssd1963_rgb(u8 r, u8 g, u8 b);
+
+/* Opens a write window, ssd1963_px() then sends its pixels row by row and
+ * ssd1963_px_end() flushes a pending half pixel. */
+void ssd1963_window(u16 x, u16 y, u16 w, u16 h);
+void ssd1963_px(u32 color);
+void ssd1963_px_end(void);
+
+void ssd1963_fill(u16 x, u16 y, u16 w, u16 h, u32 color);
+
+/* sends the w x h pixels at px, stride being in pixels */
+void ssd1963_blit(u16 x, u16 y, u16 w, u16 h, const u32 *px, unsigned stride);
+
+/* Sends the lines of frame (stride in pixels, panel sized) which changed
+ * since the last flush, the first after ssd1963_init() sends everything.
+ * Returns the number of lines sent. */
+unsigned ssd1963_flush(const u32 *frame, unsigned stride);
+
+#ifdef SSD1963_LIB_SIM
+/* ssd1963_sim.c */
+u32 ssd1963_sim_rd(unsigned reg);
+void ssd1963_sim_wr(unsigned reg, u32 v);
+void ssd1963_sim_attach(const struct ssd1963_platform_data *pdata);
+/* the simulated GRAM as xRGB, SSD1963_MAX_WIDTH pixels per line; *w and *h
+ * receive the size set by SET_LCD_MODE */
+const u32 * ssd1963_sim_gram(unsigned *w, unsigned *h);
+/* copies up to max of the commands received since the last call to cmds and
+ * returns how many there were */
+unsigned ssd1963_sim_cmds(u8 *cmds, unsigned max);
+/* writes the visible part of GRAM as binary PPM, returns 0 or -errno */
+int ssd1963_sim_dump(const char *path);
+#endif
+
+#endif
@@ -24,12 +24,11 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <linux/delay.h>
-
 #include "ssd1963_fb.h"
 
 #define SSD_WR_CMD(x)	ssd_wr_slow_cmd(x)
 #define SSD_WR_DATA(x)	ssd_wr_slow_data(x)
+#define SSD_RD_DATA()	ssd_rd_slow_data()
 
 #include "ssd1963_cmd.h"
 
@@ -39,9 +38,18 @@ static void ssd_sleep(unsigned ms)
 	msleep(ms);
 }
 
+static void ssd_usleep(unsigned us)
+{
+	usleep_range(us, us + us / 4);
+}
+
 #define STR(x)			#x
 #define XSTR(x)			STR(x)
 
+/* ms to wait for the PLL to lock, polled in steps of us if readable */
+#define SSD_PLL_LOCK_TIMEOUT	100
+#define SSD_PLL_POLL_US		250
+
 /* in kHz */
 #define SSD_VCO_MIN		250000
 #define SSD_VCO_MAX		800000
@@ -82,6 +90,16 @@ uint_least32_t ssd_iv_get_pixel_freq_frac(const struct ssd_init_vector *iv)
 	return f;
 }
 
+uint_least32_t ssd_iv_get_line_ns(const struct ssd_init_vector *iv)
+{
+	uint_least32_t pclk = ssd_iv_get_pixel_freq_frac(iv); /* kHz */
+
+	if (!pclk)
+		return 0;
+	/* ht * 10^6 / pclk without overflowing 32 bit */
+	return iv->ht * (1000000 / pclk) + iv->ht * (1000000 % pclk) / pclk;
+}
+
 uint_least32_t ssd_iv_calc_pixel_freq(
 	const struct ssd_init_vector *iv,
 	uint_least16_t refresh_rate
@@ -154,7 +172,7 @@ void ssd_iv_print(const struct ssd_init_vector *iv)
 	uint_least32_t pclk_hz_m =  pclk_hz % (iv->ht * iv->vt);
 	uint_least32_t pclk_hz_f = (pclk_hz_m * 1000) / (iv->ht * iv->vt);
 
-	printk(KERN_INFO SSD1963_FB_DRIVER_NAME ": "
+	printk(KERN_INFO SSD_LOG_NAME ": "
 		"in_clk_freq: %u kHz, "
 		"PLL: %u/%u -> %u kHz, "
 		"VCO: %u kHz\n",
@@ -162,7 +180,7 @@ void ssd_iv_print(const struct ssd_init_vector *iv)
 		iv->pll_m, iv->pll_n, ssd_iv_get_pll_freq(iv),
 		ssd_iv_get_vco_freq(iv));
 
-	printk(KERN_INFO SSD1963_FB_DRIVER_NAME ": "
+	printk(KERN_INFO SSD_LOG_NAME ": "
 		"sys: %u kHz, "
 		"px clk: %u kHz, "
 		"lshift: %u, rate: %u.%03u Hz\n",
@@ -170,15 +188,15 @@ void ssd_iv_print(const struct ssd_init_vector *iv)
 		pclk,
 		iv->lshift_mult, pclk_hz_d, pclk_hz_f);
 
-	printk(KERN_INFO SSD1963_FB_DRIVER_NAME ": "
+	printk(KERN_INFO SSD_LOG_NAME ": "
 		"ht, hps, hpw, lps, lpspp: %hu %hu %hu %hu %hu\n",
 		iv->ht, iv->hps, iv->hpw, iv->lps, iv->lpspp);
 
-	printk(KERN_INFO SSD1963_FB_DRIVER_NAME ": "
+	printk(KERN_INFO SSD_LOG_NAME ": "
 		"vt, vps, vpw, fps       : %hu %hu %hu %hu\n",
 		iv->vt, iv->vps, iv->vpw, iv->fps);
 
-	printk(KERN_INFO SSD1963_FB_DRIVER_NAME ": "
+	printk(KERN_INFO SSD_LOG_NAME ": "
 		"hdp: %hu, "
 		"vdp: %hu, "
 		"lcd-flags: 0x%02x 0x%02x 0x%02x\n",
@@ -208,7 +226,9 @@ const char * ssd_strerr(enum ssd_err err)
 		[SSD_ERR_PXCLK_UNAVAIL]
 		= "refresh_rate not set and no typical pixel clock frequency available for the display",
 		[SSD_ERR_PXCLK_OOR]
-		= "pixel clock frequency out of range for the display"
+		= "pixel clock frequency out of range for the display",
+		[SSD_ERR_SCRIPT_FULL]
+		= "too many commands for init script (" XSTR(SSD_SCRIPT_MAX_OPS) ")"
 	};
 
 	if (err < ARRAY_SIZE(err_msgs))
@@ -284,79 +304,297 @@ enum ssd_err ssd_iv_check(const struct ssd_init_vector *iv)
 	return SSD_ERR_NONE;
 }
 
-enum ssd_err ssd_init_pll(const struct ssd_init_vector *iv)
+/* --------------------------------------------------------------------------
+ * init scripts
+ * -------------------------------------------------------------------------- */
+
+static const struct ssd_bus_ops ssd_slow_bus_ops = {
+	.wr_cmd  = ssd_wr_slow_cmd,
+	.wr_data = ssd_wr_slow_data,
+	.rd_data = ssd_rd_slow_data,
+};
+
+enum ssd_err ssd_script_add(struct ssd_script *s, unsigned flags,
+                            unsigned delay, const unsigned char *k, unsigned n)
 {
-	enum ssd_err r = SSD_ERR_NONE;
+	struct ssd_script_op *op;
+
+	if (s->n >= SSD_SCRIPT_MAX_OPS || n > SSD_SCRIPT_MAX_PARAMS)
+		return SSD_ERR_SCRIPT_FULL;
+
+	op = &s->ops[s->n++];
+	memset(op, 0, sizeof(*op));
+	op->cmd   = k[0];
+	op->n     = n;
+	op->flags = flags;
+	op->delay = delay;
+	memcpy(op->params, k + 1, n);
+	return SSD_ERR_NONE;
+}
+
+enum ssd_err ssd_script_add_poll(struct ssd_script *s, unsigned char cmd,
+                                 unsigned char mask, unsigned timeout)
+{
+	enum ssd_err r;
+
+	r = SSD_SCRIPT_CMD(s, SSD_SCRIPT_ALWAYS | SSD_SCRIPT_POLL, timeout, cmd);
+	if (r == SSD_ERR_NONE)
+		s->ops[s->n - 1].params[0] = mask;
+	return r;
+}
+
+enum ssd_err ssd_script_pll(struct ssd_script *s,
+                            const struct ssd_init_vector *iv)
+{
+	enum ssd_err r;
 
 	r = ssd_iv_check(iv);
 	if (r != SSD_ERR_NONE)
 		return r;
 
-	SSD_SET_DISPLAY_OFF();
+	/* SET_DISPLAY_OFF; disable usage of PLL as system clock and the PLL
+	 * itself; SET_PLL_MN, effectuating the settings; enable the PLL */
+	r = SSD_SCRIPT_CMD(s, SSD_SCRIPT_ALWAYS, 0, 0x28);
+	if (!r) r = SSD_SCRIPT_CMD(s, SSD_SCRIPT_ALWAYS, 0, 0xe0, 0x00);
+	if (!r) r = SSD_SCRIPT_CMD(s, SSD_SCRIPT_ALWAYS, 0, 0xe2,
+	                           iv->pll_m - 1, iv->pll_n - 1, 0x04);
+	if (!r) r = SSD_SCRIPT_CMD(s, SSD_SCRIPT_ALWAYS, 0, 0xe0, 0x01);
+	/* GET_PLL_STATUS until locked */
+	if (!r) r = ssd_script_add_poll(s, 0xe4, 0x04, SSD_PLL_LOCK_TIMEOUT);
+	/* ok, PLL stable, use as system clock if requested */
+	if (!r && iv->pll_as_sysclk)
+		r = SSD_SCRIPT_CMD(s, SSD_SCRIPT_ALWAYS, 0, 0xe0, 0x03);
+	/* SOFT_RESET, need to wait 5ms after it */
+	if (!r) r = SSD_SCRIPT_CMD(s, SSD_SCRIPT_ALWAYS, 5, 0x01);
 
-	/* disable usage of PLL as system clock and the PLL itself */
-	SSD_SET_PLL(0x00);
+	return r;
+}
 
-	SSD_SET_PLL_MN(
-		iv->pll_m - 1,
-		iv->pll_n - 1,
-		0x04);         /* effectuate PLL settings */
+enum ssd_err ssd_script_display(struct ssd_script *s,
+                                const struct ssd_init_vector *iv)
+{
+	uint_least32_t fpr = iv->lshift_mult - 1;
+	uint_least16_t hps;
+	enum ssd_err r;
 
-	/* enable PLL and wait 100ms for it to settle */
-	SSD_SET_PLL(0x01);
-	ssd_sleep(100);
+	r = ssd_iv_check(iv);
+	if (r != SSD_ERR_NONE)
+		return r;
 
-#ifdef SSD_RD_DATA
-	SSD_GET_PLL_STATUS();
-	if (!(SSD_RD_DATA() & 0x04)) {
-		/* PLL unstable, deactivate it */
-		SSD_SET_PLL(0x00);
-		return SSD_ERR_PLL_UNSTABLE;
+	hps = iv->hps + (iv->lcd_flags & SSD_LCD_MODE_SERIAL ? iv->lpspp : 0);
+
+	/* SET_LSHIFT_FREQ */
+	r = SSD_SCRIPT_CMD(s, 0, 0, 0xe6, fpr >> 16, fpr >> 8, fpr);
+	/* SET_LCD_MODE */
+	if (!r) r = SSD_SCRIPT_CMD(s, 0, 0, 0xb0,
+	                           (iv->lcd_flags >> 16),
+	                           (iv->lcd_flags >>  8) & 0xff,
+	                           (iv->hdp - 1) >> 8, iv->hdp - 1,
+	                           (iv->vdp - 1) >> 8, iv->vdp - 1,
+	                           (iv->lcd_flags      ) & 0xff);
+	/* SET_HORI_PERIOD */
+	if (!r) r = SSD_SCRIPT_CMD(s, 0, 0, 0xb4,
+	                           (iv->ht - 1) >> 8, iv->ht - 1,
+	                           hps >> 8, hps,
+	                           iv->hpw - 1,
+	                           iv->lps >> 8, iv->lps,
+	                           iv->lpspp);
+	/* SET_VERT_PERIOD */
+	if (!r) r = SSD_SCRIPT_CMD(s, 0, 0, 0xb6,
+	                           (iv->vt - 1) >> 8, iv->vt - 1,
+	                           iv->vps >> 8, iv->vps,
+	                           iv->vpw - 1,
+	                           iv->fps >> 8, iv->fps);
+	/* SET_DISPLAY_ON */
+	if (!r) r = SSD_SCRIPT_CMD(s, 0, 0, 0x29);
+
+	return r;
+}
+
+static int ssd_script_op_eq(const struct ssd_script_op *a,
+                            const struct ssd_script_op *b)
+{
+	return a->cmd == b->cmd && a->n == b->n &&
+	       !memcmp(a->params, b->params, a->n);
+}
+
+/* Polls in steps of SSD_PLL_POLL_US. Without readback, the timeout (i.e. the
+ * datasheet's settling time) is all we can rely on. */
+static int ssd_script_poll(const struct ssd_bus_ops *bus,
+                           const struct ssd_script_op *op)
+{
+	unsigned t;
+	int v;
+
+	for (t = 0; t < op->delay * 1000U; t += SSD_PLL_POLL_US) {
+		bus->wr_cmd(op->cmd);
+		v = bus->rd_data ? bus->rd_data() : -1;
+		if (v < 0) {
+			ssd_sleep(op->delay - t / 1000);
+			return 0;
+		}
+		if (v & op->params[0])
+			return 0;
+		ssd_usleep(SSD_PLL_POLL_US);
 	}
-#endif
+	return -1;
+}
 
-	/* ok, PLL stable, use as system clock if requested */
-	if (iv->pll_as_sysclk)
-		SSD_SET_PLL(0x03);
+enum ssd_err ssd_script_run(const struct ssd_bus_ops *bus,
+                            const struct ssd_script *s,
+                            const struct ssd_script *prev)
+{
+	const struct ssd_script_op *op;
+	unsigned i, j;
+
+	for (i = 0; i < s->n; i++) {
+		op = &s->ops[i];
+		if (prev && i < prev->n && !(op->flags & SSD_SCRIPT_ALWAYS) &&
+		    ssd_script_op_eq(op, &prev->ops[i]))
+			continue;
+		if (op->flags & SSD_SCRIPT_POLL) {
+			if (ssd_script_poll(bus, op))
+				return SSD_ERR_PLL_UNSTABLE;
+			continue;
+		}
+		bus->wr_cmd(op->cmd);
+		for (j = 0; j < op->n; j++)
+			bus->wr_data(op->params[j]);
+		if (op->delay)
+			ssd_sleep(op->delay);
+	}
+	return SSD_ERR_NONE;
+}
 
-	/* need to wait 5ms after soft reset */
-	SSD_SOFT_RESET();
-	ssd_sleep(5);
+void ssd_script_print(const struct ssd_script *s)
+{
+	const struct ssd_script_op *op;
+	char buf[3 * SSD_SCRIPT_MAX_PARAMS + 1];
+	unsigned i, j;
+
+	for (i = 0; i < s->n; i++) {
+		op = &s->ops[i];
+		for (j = 0; j < op->n; j++)
+			snprintf(buf + 3 * j, 4, " %02x", op->params[j]);
+		buf[3 * j] = '\0';
+		printk(KERN_DEBUG SSD_LOG_NAME ": "
+			"script[%u]: %02x%s%s, %u ms%s\n",
+			i, op->cmd, op->n ? ":" : "", buf, op->delay,
+			op->flags & SSD_SCRIPT_POLL ? " poll" : "");
+	}
+}
 
+enum ssd_err ssd_pll_wait_lock(unsigned timeout)
+{
+	struct ssd_script s = { .n = 0 };
+	enum ssd_err r;
+
+	r = ssd_script_add_poll(&s, 0xe4, 0x04, timeout);
+	if (r == SSD_ERR_NONE)
+		r = ssd_script_run(&ssd_slow_bus_ops, &s, NULL);
 	return r;
 }
 
-enum ssd_err ssd_init_display(const struct ssd_init_vector *iv)
+enum ssd_err ssd_init_pll(const struct ssd_init_vector *iv)
 {
-	enum ssd_err r = SSD_ERR_NONE;
+	struct ssd_script s = { .n = 0 };
+	enum ssd_err r;
 
-	r = ssd_iv_check(iv);
+	r = ssd_script_pll(&s, iv);
 	if (r != SSD_ERR_NONE)
 		return r;
 
-	SSD_SET_LSHIFT_FREQ(iv->lshift_mult - 1);
+	r = ssd_script_run(&ssd_slow_bus_ops, &s, NULL);
+	if (r == SSD_ERR_PLL_UNSTABLE) {
+		/* PLL unstable, deactivate it */
+		SSD_SET_PLL(0x00);
+	}
+	return r;
+}
+
+enum ssd_err ssd_init_display(const struct ssd_init_vector *iv)
+{
+	struct ssd_script s = { .n = 0 };
+	enum ssd_err r;
+
+	r = ssd_script_display(&s, iv);
+	if (r == SSD_ERR_NONE)
+		r = ssd_script_run(&ssd_slow_bus_ops, &s, NULL);
+	return r;
+}
+
+/* reads n parameter bytes of the previous command into buf */
+static int ssd_rd_params(unsigned char *buf, unsigned n)
+{
+	int v;
 
-	SSD_SET_LCD_MODE(
-		(iv->lcd_flags >> 16),
-		(iv->lcd_flags >>  8) & 0xff,
-		iv->hdp - 1,
-		iv->vdp - 1,
-		(iv->lcd_flags      ) & 0xff);
+	while (n--) {
+		v = SSD_RD_DATA();
+		if (v < 0)
+			return -1;
+		*buf++ = v;
+	}
+	return 0;
+}
 
-	SSD_SET_HORI_PERIOD(
-		iv->ht - 1,
-		iv->hps + (iv->lcd_flags & SSD_LCD_MODE_SERIAL ? iv->lpspp : 0),
-		iv->hpw - 1,
-		iv->lps,
-		iv->lpspp);
+#define SSD_BE16(p)	((unsigned)(p)[0] << 8 | (p)[1])
 
-	SSD_SET_VERT_PERIOD(
-		iv->vt - 1,
-		iv->vps,
-		iv->vpw - 1,
-		iv->fps);
+int ssd_iv_matches_hw(const struct ssd_init_vector *iv)
+{
+	unsigned char b[8];
 
-	SSD_SET_DISPLAY_ON();
+	SSD_GET_PLL_MN();
+	if (ssd_rd_params(b, 3))
+		return -1;
+	if (b[0] != iv->pll_m - 1 || (b[1] & 0x0f) != iv->pll_n - 1)
+		return 0;
 
-	return r;
+	SSD_GET_PLL_STATUS();
+	if (ssd_rd_params(b, 1) || !(b[0] & 0x04))
+		return 0;
+
+	SSD_GET_LCD_MODE();
+	if (ssd_rd_params(b, 7) ||
+	    (b[0] & 0x3f) != ((iv->lcd_flags >> 16) & 0x3f) ||
+	    (b[1] & 0x60) != ((iv->lcd_flags >>  8) & 0x60) ||
+	    (SSD_BE16(b + 2) & 0x7ff) != iv->hdp - 1 ||
+	    (SSD_BE16(b + 4) & 0x7ff) != iv->vdp - 1 ||
+	    (b[6] & 0x3f) != (iv->lcd_flags & 0x3f))
+		return 0;
+
+	SSD_GET_HORI_PERIOD();
+	if (ssd_rd_params(b, 8) ||
+	    (SSD_BE16(b + 0) & 0xfff) != iv->ht - 1 ||
+	    (SSD_BE16(b + 2) & 0x7ff) != iv->hps +
+		(iv->lcd_flags & SSD_LCD_MODE_SERIAL ? iv->lpspp : 0) ||
+	    (b[4] & 0x7f) != iv->hpw - 1 ||
+	    (SSD_BE16(b + 5) & 0x7ff) != iv->lps ||
+	    (b[7] & 0x03) != iv->lpspp)
+		return 0;
+
+	SSD_GET_VERT_PERIOD();
+	if (ssd_rd_params(b, 7) ||
+	    (SSD_BE16(b + 0) & 0xfff) != iv->vt - 1 ||
+	    (SSD_BE16(b + 2) & 0x7ff) != iv->vps ||
+	    (b[4] & 0x7f) != iv->vpw - 1 ||
+	    (SSD_BE16(b + 5) & 0x7ff) != iv->fps)
+		return 0;
+
+	SSD_GET_LSHIFT_FREQ();
+	if (ssd_rd_params(b, 3) ||
+	    ((uint_least32_t)(b[0] & 0x0f) << 16 | SSD_BE16(b + 1)) !=
+	    iv->lshift_mult - 1)
+		return 0;
+
+	return 1;
+}
+
+int ssd_get_scanline(void)
+{
+	unsigned char b[2];
+
+	SSD_GET_SCANLINE();
+	if (ssd_rd_params(b, 2))
+		return -1;
+	return SSD_BE16(b);
 }
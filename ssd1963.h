@@ -37,6 +37,11 @@ enum ssd_address_mode {
 	SSD_ADDR_PANEL_LINE_REFRESH_REVERSE = 1 << 2, /* SSD->panel: refresh from right to left side */
 	SSD_ADDR_PANEL_HORI_FLIP      = 1 << 1,
 	SSD_ADDR_PANEL_VERT_FLIP      = 1 << 0,
+
+	/* host->SSD: page and column exchanged, i.e. bit 5 as seen from the
+	 * host side; together with the HOST_*_REVERSE bits this rotates the
+	 * frame written by the host */
+	SSD_ADDR_HOST_PAGE_COL_EXCHANGE = 1 << 5,
 };
 
 /* mode for SSD_SET_PIXEL_DATA_INTERFACE */
@@ -125,6 +130,10 @@ uint_least32_t ssd_iv_get_sys_freq(const struct ssd_init_vector *iv);
  * lshift_freq value from iv */
 uint_least32_t ssd_iv_get_pixel_freq_frac(const struct ssd_init_vector *iv);
 
+/* returns the duration of one line (ht pixel clocks) in ns, 0 if the pixel
+ * clock is invalid */
+uint_least32_t ssd_iv_get_line_ns(const struct ssd_init_vector *iv);
+
 /* in kHz */
 uint_least32_t ssd_iv_calc_pixel_freq(
 	const struct ssd_init_vector *iv,
@@ -169,6 +178,7 @@ enum ssd_err {
 	SSD_ERR_PLL_UNSTABLE,
 	SSD_ERR_PXCLK_UNAVAIL,
 	SSD_ERR_PXCLK_OOR,
+	SSD_ERR_SCRIPT_FULL,
 };
 
 const char * ssd_strerr(enum ssd_err err);
@@ -190,16 +200,94 @@ enum ssd_err ssd_iv_check(const struct ssd_init_vector *iv);
  * 
  * If iv is invalid as determined by ssd_iv_check(), its error code is returned.
  * 
- * If the macro SSD_RD_DATA is defined and after programming the PLL verifying
- * its stability by querying the controller fails, this function returns
- * SSD_ERR_PLL_UNSTABLE. In that case the PLL is shut down and the controller is
- * not reset. */
+ * If after programming the PLL it doesn't lock as determined by
+ * ssd_pll_wait_lock(), this function returns SSD_ERR_PLL_UNSTABLE. In that case
+ * the PLL is shut down and the controller is not reset. */
 enum ssd_err ssd_init_pll(const struct ssd_init_vector *iv);
 
+/* Polls GET_PLL_STATUS for up to timeout ms until the PLL reports lock and
+ * returns SSD_ERR_PLL_UNSTABLE if it didn't. If the controller can't be read
+ * from (SSD_RD_DATA returns a negative value) it just waits timeout ms. */
+enum ssd_err ssd_pll_wait_lock(unsigned timeout);
+
 /* Sets up the pixel frequency, horizontal and vertical timings and turns the
  * display back on. */
 enum ssd_err ssd_init_display(const struct ssd_init_vector *iv);
 
+/* Reads back the PLL, LCD mode, timing and pixel clock settings, e.g. as left
+ * by a bootloader, and compares them with what ssd_init_pll() and
+ * ssd_init_display() would program for iv. Returns 1 if they match and the
+ * PLL is locked, 0 if not and -1 if the controller can't be read from. */
+int ssd_iv_matches_hw(const struct ssd_init_vector *iv);
+
+/* Reads the line the panel is being refreshed at: 0 at the start of VSYNC,
+ * row r of the display at iv->vps + r, less than iv->vt. Returns -1 if the
+ * controller can't be read from. */
+int ssd_get_scanline(void);
+
+/* --------------------------------------------------------------------------
+ * init scripts
+ * -------------------------------------------------------------------------- */
+
+/* Init sequences are built as tables of commands, which can be logged,
+ * compared with the previously executed table to only send what changed and
+ * run by a single loop through the bus operations given by the caller. */
+
+#define SSD_SCRIPT_MAX_PARAMS	9
+#define SSD_SCRIPT_MAX_OPS	16
+
+struct ssd_script_op {
+	uint_least8_t cmd, n;
+	uint_least8_t flags;
+	uint_least8_t params[SSD_SCRIPT_MAX_PARAMS]; /* for POLL: the mask */
+	uint_least16_t delay; /* ms after cmd, for POLL the timeout */
+};
+
+enum ssd_script_flags {
+	SSD_SCRIPT_ALWAYS = 1 << 0, /* side effects, never skipped by a diff */
+	SSD_SCRIPT_POLL   = 1 << 1, /* read until a bit in mask is set */
+};
+
+struct ssd_script {
+	unsigned n;
+	struct ssd_script_op ops[SSD_SCRIPT_MAX_OPS];
+};
+
+/* rd_data may be NULL or return a negative value if reading isn't possible */
+struct ssd_bus_ops {
+	void (*wr_cmd)(unsigned char);
+	void (*wr_data)(unsigned char);
+	int (*rd_data)(void);
+};
+
+/* appends cmd k[0] with n parameters k[1..n] */
+enum ssd_err ssd_script_add(struct ssd_script *s, unsigned flags,
+                            unsigned delay, const unsigned char *k, unsigned n);
+
+/* like the SSD_CMD() macro: SSD_SCRIPT_CMD(s, flags, delay, cmd, params...) */
+#define SSD_SCRIPT_CMD(s,flags,delay,...) \
+	ssd_script_add(s, flags, delay, (const unsigned char[]){ __VA_ARGS__ }, \
+	               sizeof((unsigned char[]){ __VA_ARGS__ }) - 1)
+
+enum ssd_err ssd_script_add_poll(struct ssd_script *s, unsigned char cmd,
+                                 unsigned char mask, unsigned timeout);
+
+/* The scripts equivalent to ssd_init_pll() and ssd_init_display(), appended
+ * to s. */
+enum ssd_err ssd_script_pll(struct ssd_script *s,
+                            const struct ssd_init_vector *iv);
+enum ssd_err ssd_script_display(struct ssd_script *s,
+                                const struct ssd_init_vector *iv);
+
+/* Runs s, skipping commands equal to the ones at the same position in prev
+ * (if not NULL) unless marked SSD_SCRIPT_ALWAYS. A failed poll aborts with
+ * SSD_ERR_PLL_UNSTABLE. */
+enum ssd_err ssd_script_run(const struct ssd_bus_ops *bus,
+                            const struct ssd_script *s,
+                            const struct ssd_script *prev);
+
+void ssd_script_print(const struct ssd_script *s);
+
 /* Convenience function to fully initialize the controller.
  *
  * Fills a ssd_init_vector structure with all the information given in the
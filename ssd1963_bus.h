@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2013, Franz Brauße
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SSD1963_BUS_H
+#define SSD1963_BUS_H
+
+/* Bitbanging the SSD1963's 8080 style bus on the BCM2708's GPIO bank 0,
+ * shared by the kernel driver and libssd1963. The includer defines how the
+ * GPIO block is accessed, reg being one of the SSD_GPIO_* offsets:
+ *   SSD_GPIO_RD(reg)             reads a register
+ *   SSD_GPIO_WR(reg,v)           writes a register, ordered with prior I/O
+ *   SSD_GPIO_WR_RELAXED(reg,v)   writes a register on the fast path
+ *   SSD_BUS_DELAY(n)             busy waits for about n nops
+ * and optionally SSD_BUS_WAIT1 and SSD_BUS_WAIT2, the slow path's delays. */
+
+#include "ssd1963_fb.h"
+
+#if !defined(SSD_GPIO_RD) || !defined(SSD_GPIO_WR) || \
+    !defined(SSD_GPIO_WR_RELAXED) || !defined(SSD_BUS_DELAY)
+# error ssd1963_bus.h needs definitions of the macros SSD_GPIO_RD, SSD_GPIO_WR, SSD_GPIO_WR_RELAXED, SSD_BUS_DELAY
+#endif
+
+/* The data bus' pin map is given in the platform data. Values are spread
+ * over the GPIO bank by one lookup table per byte lane. */
+struct ssd_bus {
+	u32 data_mask, dc_mask, wr_mask, rd_mask;
+	u32 lut[(SSD1963_MAX_BUS_WIDTH + 7) / 8][256];
+	/* for reading: function select bits of the data lines per GPFSEL
+	 * register and the pins of D0-D7 */
+	u32 fsel_mask[4], fsel_out[4];
+	u8 rd_pins[8];
+};
+
+static inline u32 ssd_bus_enc(const struct ssd_bus *bus, u32 v)
+{
+	return bus->lut[0][v         & 0xff] |
+	       bus->lut[1][(v >>  8) & 0xff] |
+	       bus->lut[2][(v >> 16) & 0xff];
+}
+
+/* number of data lines used by the interface format */
+static inline unsigned ssd_bus_fmt_width(enum ssd_interface_fmt bus_fmt)
+{
+	switch (bus_fmt) {
+	case SSD_DATA_8:         return 8;
+	case SSD_DATA_9:         return 9;
+	case SSD_DATA_12:        return 12;
+	case SSD_DATA_16_PACKED:
+	case SSD_DATA_16_565:    return 16;
+	case SSD_DATA_18:        return 18;
+	case SSD_DATA_24:        return 24;
+	}
+	return ~0U;
+}
+
+/* Builds the lookup tables for the wiring in pdata. Returns -EINVAL if it is
+ * invalid, setting *bad_pin to the offending pin or to SSD1963_PIN_NONE if
+ * the interface format needs more data lines than are connected. */
+static inline int ssd_bus_setup(struct ssd_bus *bus,
+				const struct ssd1963_platform_data *pdata,
+				unsigned *bad_pin)
+{
+	unsigned i, v;
+	u32 m;
+
+	if (pdata->bus_width > SSD1963_MAX_BUS_WIDTH ||
+	    pdata->bus_width < ssd_bus_fmt_width(pdata->bus_fmt)) {
+		*bad_pin = SSD1963_PIN_NONE;
+		return -EINVAL;
+	}
+
+	memset(bus, 0, sizeof(*bus));
+	m = 0;
+	for (i = 0; i < pdata->bus_width + 3; i++) {
+		unsigned pin = i < pdata->bus_width ? pdata->data_pins[i]
+		             : i == pdata->bus_width ? pdata->dc_pin
+		             : i == pdata->bus_width + 1 ? pdata->wr_pin
+		             : pdata->rd_pin;
+		if (pin == SSD1963_PIN_NONE && i == pdata->bus_width + 2)
+			break;
+		if (pin >= 32 || m & 1 << pin) {
+			*bad_pin = pin;
+			return -EINVAL;
+		}
+		m |= 1 << pin;
+	}
+
+	for (i = 0; i < pdata->bus_width; i++) {
+		u32 (*lut)[256] = &bus->lut[i / 8];
+		for (v = 0; v < 256; v++)
+			if (v & 1 << (i % 8))
+				(*lut)[v] |= 1 << pdata->data_pins[i];
+		bus->data_mask |= 1 << pdata->data_pins[i];
+	}
+	bus->dc_mask = 1 << pdata->dc_pin;
+	bus->wr_mask = 1 << pdata->wr_pin;
+
+	if (pdata->rd_pin != SSD1963_PIN_NONE) {
+		bus->rd_mask = 1 << pdata->rd_pin;
+		for (i = 0; i < pdata->bus_width; i++) {
+			v = pdata->data_pins[i];
+			bus->fsel_mask[v / 10] |= 7 << (v % 10 * 3);
+			bus->fsel_out[v / 10]  |= 1 << (v % 10 * 3);
+		}
+		for (i = 0; i < 8; i++)
+			bus->rd_pins[i] = pdata->data_pins[i];
+	}
+
+	return 0;
+}
+
+/* slow bus access */
+
+#ifndef SSD_BUS_WAIT1
+#define SSD_BUS_WAIT1	SSD_BUS_DELAY(30)
+#define SSD_BUS_WAIT2	SSD_BUS_DELAY(60)
+#endif
+
+static inline void ssd_bus_wr_slow_data(const struct ssd_bus *bus, u8 v)
+{
+	u32 d = ssd_bus_enc(bus, v);
+
+	SSD_GPIO_WR(SSD_GPIO_CLR0, bus->wr_mask);
+	SSD_BUS_WAIT1;
+	SSD_GPIO_WR(SSD_GPIO_CLR0, ~d & bus->data_mask);
+	SSD_BUS_WAIT1;
+	SSD_GPIO_WR(SSD_GPIO_SET0,  d & bus->data_mask);
+	SSD_BUS_WAIT2; /* todo: WAIT1? */
+	SSD_GPIO_WR(SSD_GPIO_SET0, bus->wr_mask);
+	SSD_BUS_WAIT2;
+}
+
+static inline void ssd_bus_wr_slow_cmd(const struct ssd_bus *bus, u8 v)
+{
+	u32 d = ssd_bus_enc(bus, v);
+
+	SSD_GPIO_WR(SSD_GPIO_CLR0, bus->dc_mask);
+	SSD_BUS_WAIT1;
+	SSD_GPIO_WR(SSD_GPIO_CLR0, bus->wr_mask);
+	SSD_BUS_WAIT1;
+	SSD_GPIO_WR(SSD_GPIO_CLR0, ~d & bus->data_mask);
+	SSD_GPIO_WR(SSD_GPIO_SET0,  d & bus->data_mask);
+	SSD_BUS_WAIT1;
+	SSD_GPIO_WR(SSD_GPIO_SET0, bus->wr_mask);
+	SSD_BUS_WAIT1;
+	SSD_GPIO_WR(SSD_GPIO_SET0, bus->dc_mask);
+	SSD_BUS_WAIT2;
+}
+
+/* switches the data lines to outputs or inputs */
+static inline void ssd_bus_dir(const struct ssd_bus *bus, int out)
+{
+	unsigned i;
+	u32 r;
+
+	for (i = 0; i < ARRAY_SIZE(bus->fsel_mask); i++) {
+		if (!bus->fsel_mask[i])
+			continue;
+		r = SSD_GPIO_RD(SSD_GPIO_FSEL(i)) & ~bus->fsel_mask[i];
+		if (out)
+			r |= bus->fsel_out[i];
+		SSD_GPIO_WR(SSD_GPIO_FSEL(i), r);
+	}
+}
+
+/* returns the byte read or -1 if no #RD line is connected */
+static inline int ssd_bus_rd_slow(const struct ssd_bus *bus)
+{
+	unsigned i;
+	u32 lev;
+	int v = 0;
+
+	if (!bus->rd_mask)
+		return -1;
+
+	ssd_bus_dir(bus, 0);
+	SSD_GPIO_WR(SSD_GPIO_CLR0, bus->rd_mask);
+	SSD_BUS_WAIT2;
+	lev = SSD_GPIO_RD(SSD_GPIO_LEV0);
+	SSD_GPIO_WR(SSD_GPIO_SET0, bus->rd_mask);
+	SSD_BUS_WAIT1;
+	ssd_bus_dir(bus, 1);
+
+	for (i = 0; i < 8; i++)
+		if (lev & 1 << bus->rd_pins[i])
+			v |= 1 << i;
+	return v;
+}
+
+/* fast bus access */
+
+static inline void ssd_bus_wr0(const struct ssd_bus *bus, u32 d)
+{
+	/* the barrier was issued at cmd submission time already and ARM
+	 * doesn't reorder writes to the same subsystem */
+	SSD_GPIO_WR_RELAXED(SSD_GPIO_CLR0, (~d & bus->data_mask) | bus->wr_mask);
+	SSD_GPIO_WR_RELAXED(SSD_GPIO_SET0,   d & bus->data_mask);
+	SSD_GPIO_WR_RELAXED(SSD_GPIO_SET0,                        bus->wr_mask);
+}
+
+/* repeats the word currently on the data lines by only toggling #WR */
+static inline void ssd_bus_strobe(const struct ssd_bus *bus)
+{
+	SSD_GPIO_WR_RELAXED(SSD_GPIO_CLR0, bus->wr_mask);
+	SSD_GPIO_WR_RELAXED(SSD_GPIO_SET0, bus->wr_mask);
+}
+
+/* consecutive equal words are sent by strobing #WR only */
+static inline void ssd_bus_wr_words(const struct ssd_bus *bus, const u32 *w,
+				    unsigned n)
+{
+	u32 last = ~0; /* never a valid data word */
+
+	for (; n; n--, w++) {
+		if (*w == last) {
+			ssd_bus_strobe(bus);
+		} else {
+			last = *w;
+			ssd_bus_wr0(bus, last);
+		}
+	}
+}
+
+/* The pixel encoders translate a color in the bus format's layout into the
+ * GPIO words to be put on the bus, returning their count (at most
+ * SSD_PX_MAX_WORDS). SSD_DATA_16_PACKED sends two pixels in three words and
+ * keeps the pending half in the state, which has to be reset at
+ * SSD_WRITE_MEMORY_START and flushed at the end of a transfer. */
+#define SSD_PX_MAX_WORDS	3
+
+struct ssd_px_state {
+	u8 color1;
+	u8 color1_valid : 1;
+};
+
+static inline unsigned ssd_px_enc_flush(const struct ssd_bus *bus,
+					struct ssd_px_state *st, u32 *w)
+{
+	if (st->color1_valid) {
+		w[0] = ssd_bus_enc(bus, (st->color1 << 8) & 0xff00);
+		st->color1_valid = 0;
+		return 1;
+	}
+	return 0;
+}
+
+static inline unsigned ssd_px_enc8(const struct ssd_bus *bus,
+				   struct ssd_px_state *st, u32 *w, u32 color)
+{
+	w[0] = ssd_bus_enc(bus, color >> 16);
+	w[1] = ssd_bus_enc(bus, color >>  8);
+	w[2] = ssd_bus_enc(bus, color);
+	return 3;
+}
+
+static inline unsigned ssd_px_enc9(const struct ssd_bus *bus,
+				   struct ssd_px_state *st, u32 *w, u32 color)
+{
+	w[0] = ssd_bus_enc(bus, color >> 9);
+	w[1] = ssd_bus_enc(bus, color);
+	return 2;
+}
+
+static inline unsigned ssd_px_enc12(const struct ssd_bus *bus,
+				    struct ssd_px_state *st, u32 *w, u32 color)
+{
+	w[0] = ssd_bus_enc(bus, color >> 12);
+	w[1] = ssd_bus_enc(bus, color);
+	return 2;
+}
+
+static inline unsigned ssd_px_enc16_packed(const struct ssd_bus *bus,
+					   struct ssd_px_state *st, u32 *w,
+					   u32 color)
+{
+	unsigned n;
+
+	if (st->color1_valid) {
+		w[0] = ssd_bus_enc(bus, ((u16)st->color1 << 8) |
+					((color >> 16) & 0x00ff));
+		w[1] = ssd_bus_enc(bus, color);
+		n = 2;
+	} else {
+		w[0] = ssd_bus_enc(bus, color >> 8);
+		st->color1 = color;
+		n = 1;
+	}
+	st->color1_valid = !st->color1_valid;
+	return n;
+}
+
+/* SSD_DATA_16_565, SSD_DATA_18, SSD_DATA_24 */
+static inline unsigned ssd_px_enc1(const struct ssd_bus *bus,
+				   struct ssd_px_state *st, u32 *w, u32 color)
+{
+	w[0] = ssd_bus_enc(bus, color);
+	return 1;
+}
+
+#endif
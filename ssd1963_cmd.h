@@ -40,7 +40,8 @@
  * controller is to be possible */
 
 /* reads an unsigned char by first asserting #RD and retrieving the 8 lower bits
- * on the bus when releasing #RD */
+ * on the bus when releasing #RD; may evaluate to a negative value if the
+ * controller turns out not to be readable at runtime */
 /* #define SSD_RD_DATA()	(0) */
 
 #ifdef SSD_IO_MACROS
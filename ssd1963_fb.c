@@ -13,6 +13,23 @@
 #include <linux/clk.h>
 #include <linux/printk.h>
 #include <linux/console.h>
+#include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/hardirq.h>
+#include <linux/jhash.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/async.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/cpumask.h>
+#include <linux/random.h>
+#include <linux/capability.h>
+#include <linux/compat.h>
 
 #include <asm/sizes.h>
 #include <linux/io.h>
@@ -20,6 +37,8 @@
 #include <linux/gpio.h>
 
 #include "ssd1963_fb.h"
+#include "ssd1963_ioctl.h"
+#include "ssd1963_v4l2.h"
 #include "itdb02.h"
 
 #define DRIVER_NAME		SSD1963_FB_DRIVER_NAME
@@ -33,141 +52,373 @@
 #define print_debug(fmt,...)
 #endif
 
+/* On SMP, the flush only encodes pixels into GPIO words while an emitter
+ * thread on another CPU streams them to the bus, see ssd1963_pipe_rect(). */
+#define SSD1963_PIPE_BUFS	8 /* power of 2 */
+#define SSD1963_PIPE_WORDS	4096
+
+struct ssd1963_pipe_buf {
+	u16 x, y, w, h;            /* window opened before the words if w */
+	unsigned n;
+	u32 words[SSD1963_PIPE_WORDS];
+};
+
+/* single producer (the worker), single consumer (the emitter) ring, one per
+ * panel */
+struct ssd1963_pipe {
+	const struct ssd_bus *bus; /* of the panel */
+	u32 x0, y0;                /* the panel's origin in the framebuffer */
+	struct ssd1963_pipe_buf *bufs;
+	unsigned head, tail;       /* bufs[tail..head) are ready to be sent */
+	struct ssd1963_pipe_buf *cur; /* being filled, bufs[head] */
+	struct task_struct *emitter;
+	wait_queue_head_t full_wq; /* emitter waits for buffers */
+	wait_queue_head_t free_wq; /* worker waits for the emitter */
+};
+
+/* Drawing operations are not executed in the caller's context (which for
+ * fbcon is the console lock, possibly with interrupts disabled) but recorded
+ * into a ring and drained by a kernel thread owning the bus. Colors are
+ * resolved at queue time, except for palette indices, which are looked up
+ * when executed; pixel data is copied into memory owned by the op. */
+#define SSD1963_OP_RING		256 /* power of 2 */
+
+struct ssd1963_op {
+	enum ssd1963_op_type {
+		SSD1963_OP_FILL,   /* w x h pixels of color fg */
+		SSD1963_OP_BLIT,   /* 1 bpp bitmap in data, colors fg/bg */
+		SSD1963_OP_WINDOW, /* w x h u32 colors in data */
+		SSD1963_OP_COPY,   /* w x h pixels from the last sent frame */
+		SSD1963_OP_SCROLL, /* SSD_SET_SCROLL_START(y) */
+		SSD1963_OP_FENCE,  /* completes sequence number fg */
+		SSD1963_OP_VBLANK, /* waits for the vertical blanking */
+	} type;
+	u16 x, y, w, h;
+	u32 fg, bg;
+	void *data; /* see ssd1963_op_alloc(), freed after execution */
+};
+
+/* 1 bpp blits up to SSD1963_GLYPH_MAX_PX pixels (i.e. console glyphs) are
+ * kept fully encoded as GPIO words in a LRU cache, keyed by the bitmap, its
+ * size, the resolved colors and the bus format, so that redrawing them just
+ * replays the words. Only accessed by the worker (and under bus_lock). */
+#define SSD1963_GLYPH_MAX_PX	(32 * 32)
+#define SSD1963_GLYPH_HASH_BITS	8
+
+struct ssd1963_glyph {
+	struct hlist_node node;
+	struct list_head lru;
+	u32 hash;
+	u16 w, h;
+	u32 fg, bg;
+	enum ssd_interface_fmt bus_fmt;
+	u8 *bitmap;      /* (w + 7) / 8 * h bytes, points into words[] */
+	unsigned nwords;
+	u32 words[];
+};
+
+struct ssd1963_glyph_cache {
+	struct hlist_head hash[1 << SSD1963_GLYPH_HASH_BITS];
+	struct list_head lru; /* most recently used first */
+	unsigned entries;
+	size_t bytes;
+	unsigned long hits, misses, evictions;
+};
+
+#define SSD1963_FIELDS_MAX	8 /* of interlaced flushes */
+
+/* lines of the shadow framebuffer, rotated modes are up to
+ * SSD1963_MAX_HEIGHT pixels wide, which is less than the height of
+ * SSD1963_MAX_TILES panels stacked */
+#define SSD1963_MAX_LINES	(SSD1963_MAX_TILES * SSD1963_MAX_HEIGHT)
+
 struct ssd1963_fb {
 	struct fb_info info;
 	struct platform_device *dev;
 	struct ssd1963_platform_data *pdata;
 	struct ssd_init_vector iv;
 	u32 cmap[16];
+
+	/* command queue, ops[tail..head) are pending */
+	struct ssd1963_op ops[SSD1963_OP_RING];
+	unsigned op_head, op_tail;
+	unsigned long op_dropped;  /* under op_lock */
+	spinlock_t op_lock;
+	wait_queue_head_t op_wq;   /* worker waits for ops */
+	wait_queue_head_t done_wq; /* producers wait for space/completion */
+	struct task_struct *worker;
+	struct mutex bus_lock;     /* held while commands are sent */
+
+	struct ssd1963_glyph_cache glyphs;
+
+	/* The framebuffer memory (screen_base, mmap()ed through deferred I/O)
+	 * is a shadow in the var format, prev holds the frame as it was last
+	 * sent to the controller. Lines are only transferred where they
+	 * differ; line_known marks lines whose GRAM content matches prev,
+	 * line_hashed those whose line_hash matches prev. */
+	u8 *shadow, *prev, *linebuf;
+	size_t shadow_size;
+	u32 px_mask;               /* significant bits of a shadow pixel */
+	u32 lut[256];              /* palette up to 8 bpp, in the bus format */
+	u32 scale;                 /* see ssd1963_var_scale() */
+	u32 line_hash[SSD1963_MAX_LINES];
+	unsigned long line_known[BITS_TO_LONGS(SSD1963_MAX_LINES)];
+	unsigned long line_hashed[BITS_TO_LONGS(SSD1963_MAX_LINES)];
+	unsigned long dirty[BITS_TO_LONGS(SSD1963_MAX_LINES)]; /* op_lock */
+	unsigned long flushing[BITS_TO_LONGS(SSD1963_MAX_LINES)];
+	int flush_busy;            /* op_lock */
+	struct fb_deferred_io defio;
+
+	enum ssd1963_pm_state {
+		SSD1963_PM_ON,
+		SSD1963_PM_SLEEP,      /* registers and GRAM retained */
+		SSD1963_PM_DEEP_SLEEP, /* PLL off, needs full reinit */
+	} pm_state;                /* bus_lock, worker idles unless ON */
+	int diff_only;             /* see ssd1963_shadow_submit() */
+
+	int warm;                  /* taken over in the state set_par wants */
+
+	/* the last set_par's commands, only changes to it are sent */
+	struct ssd_script par_script, par_sent;
+	int par_sent_valid;        /* bus_lock */
+
+	/* racing the beam, see ssd1963_race_start(); all bus_lock */
+	u32 line_ns;               /* panel line period */
+	u32 px_ns16;               /* measured flush time per pixel, in ns/16 */
+	u32 flush_px;              /* pixels sent by the current flush */
+	u64 race_slept;            /* ns the current flush waited */
+	int racing;
+	ktime_t race_t0;           /* when the scanline was read */
+	s32 race_c0;               /* scanline at race_t0, relative to the
+	                            * frame the flush is raced against */
+	u32 race_vsp;              /* line shown at row 0 */
+	u32 flush_start;           /* line the current flush started at */
+
+	/* used by the flush if pipes[0].emitter != NULL, one per panel */
+	struct ssd1963_pipe pipes[SSD1963_MAX_TILES];
+
+	/* spanned panels, see ssd1963_bus; tile_* in the var's resolution */
+	u32 tiles_x, tiles_y, ntiles;
+	u32 tile_w, tile_h;
+
+	/* command buffers, see ssd1963_exec_fence() */
+	struct mutex cmd_lock;     /* serializes SSD1963_IOC_SUBMIT */
+	u32 seq_head;              /* cmd_lock, last sequence number given */
+	u32 seq_done;              /* op_lock, sent up to this one */
+	u32 seq_next;              /* op_lock, sent by the next flush */
+	u32 seq_flushing;          /* op_lock, sent by the current flush */
+
+	/* interlaced flushes, see ssd1963_flush_fields(); all op_lock */
+	int interlace_req;         /* SSD1963_DAMAGE_F_INTERLACE */
+	u32 field;                 /* fields sent, in coarse to fine order */
+	u32 seq_defer[SSD1963_FIELDS_MAX - 1];
+	int mmap_direct;           /* SSD1963_IOC_MMAP_MODE */
+
+	async_cookie_t probe_cookie;
+	int registered;            /* by ssd1963_fb_probe_async() */
 };
 
 static struct ssd1963_fb this_fb;
 
-/* 22-25, 28-31 */
-#define BUS8(v)		(((u32)(v) & 0x0f) << 22 | ((u32)(v) & 0xf0) << (28 - 4))
-/* 22-25, 27-31 */
-#define BUS9(v)		(((u32)(v) & 0x0f) << 22 | ((u32)(v) & 0x1f0) << (27 - 4))
+static int ssd1963_fb_sync(struct fb_info *info);
+static void ssd1963_shadow_invalidate(struct ssd1963_fb *fb);
 
-#define BUS_DC_MASK	(1 << 17)
-#define BUS_WR_MASK	(1 << 18)
+/* the slow path's delays in percent of ssd1963_bus.h's, to qualify long
+ * cables, see bench/run; the nops they take are computed when it is set */
+static unsigned bus_wait = 100;
+static unsigned ssd1963_bus_wait1 = 30, ssd1963_bus_wait2 = 60;
 
-#define BUS		BUS8
-#define BUS_MASK	BUS(~0)
-// #define BUS_CMD_MASK	BUS(0xff) /* commands are only 8 bit wide */
-#define BUS_CTL_MASK	(BUS_DC_MASK | BUS_WR_MASK)
+static int ssd1963_bus_wait_set(const char *val, const struct kernel_param *kp)
+{
+	unsigned v;
+	int ret;
+
+	ret = kstrtouint(val, 0, &v);
+	if (ret)
+		return ret;
+	v = clamp(v, 100U, 10000U);
+	ssd1963_bus_wait1 = 30 * v / 100;
+	ssd1963_bus_wait2 = 60 * v / 100;
+	bus_wait = v;
+	return 0;
+}
+
+static struct kernel_param_ops ssd1963_bus_wait_ops = {
+	.set = ssd1963_bus_wait_set,
+	.get = param_get_uint,
+};
+module_param_cb(bus_wait, &ssd1963_bus_wait_ops, &bus_wait, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(bus_wait, "command timing in percent of the default, "
+	"100 to 10000 (default: 100)");
 
 #if 1
 #include <mach/platform.h>
 
-#define GPIO_CLR_BANK0	(__io_address(GPIO_BASE) + 0x28)
-#define GPIO_SET_BANK0	(__io_address(GPIO_BASE) + 0x1c)
-
 static void nop_n(unsigned n)
 {
 	while (n--)
 		nop();
 }
 
-/* slow bus access */
-
-#define WAIT1	nop_n(30)
-#define WAIT2	nop_n(60)
+#define GPIO_REG(reg)			(__io_address(GPIO_BASE) + (reg))
+#define SSD_GPIO_RD(reg)		readl(GPIO_REG(reg))
+#define SSD_GPIO_WR(reg, v)		writel(v, GPIO_REG(reg))
+#define SSD_GPIO_WR_RELAXED(reg, v)	writel_relaxed(v, GPIO_REG(reg))
+#define SSD_BUS_DELAY(n)		nop_n(n)
+#define SSD_BUS_WAIT1			nop_n(ssd1963_bus_wait1)
+#define SSD_BUS_WAIT2			nop_n(ssd1963_bus_wait2)
+#else
+#define SSD_GPIO_RD(reg)		0
+#define SSD_GPIO_WR(reg, v)		do {} while (0)
+#define SSD_GPIO_WR_RELAXED(reg, v)	do {} while (0)
+#define SSD_BUS_DELAY(n)		do {} while (0)
+#endif
 
-void ssd_wr_slow_data(u8 v)
-{
-	u32 d = BUS(v);
-	if (0)
-		print_debug("%02x\n", v);
+#include "ssd1963_bus.h"
 
-	writel(BUS_WR_MASK, GPIO_CLR_BANK0);
-	WAIT1;
-	writel(~d & BUS_MASK, GPIO_CLR_BANK0);
-	WAIT1;
-	writel( d & BUS_MASK, GPIO_SET_BANK0);
-	WAIT2; /* todo: WAIT1? */
-	writel(BUS_WR_MASK, GPIO_SET_BANK0);
-	WAIT2;
-}
+/* With several panels spanned, each has a bus of its own, while ssd1963_bus
+ * drives all of them at once: its masks and lookup tables are the union of
+ * theirs, so every command reaches the controllers in lockstep. Only pixels
+ * are sent to each panel separately, see ssd1963_flush_send(). Reading is
+ * done from the first. */
+static struct ssd_bus ssd1963_bus;
+static struct ssd_bus ssd1963_tile_bus[SSD1963_MAX_TILES];
 
-void ssd_wr_slow_cmd(u8 v)
-{
-	u32 d = BUS(v);
-	if (0)
-		print_debug("%02x\n", v);
+/* the bus pixels are encoded for, see ssd1963_pipe_rect() */
+static const struct ssd_bus *ssd1963_enc_bus = &ssd1963_bus;
 
-	writel(BUS_DC_MASK, GPIO_CLR_BANK0);
-	WAIT1;
-	writel(BUS_WR_MASK, GPIO_CLR_BANK0);
-	WAIT1;
-	writel(~d & BUS_MASK, GPIO_CLR_BANK0);
-	writel( d & BUS_MASK, GPIO_SET_BANK0);
-	WAIT1;
-	writel(BUS_WR_MASK, GPIO_SET_BANK0);
-	WAIT1;
-	writel(BUS_DC_MASK, GPIO_SET_BANK0);
-	WAIT2;
-}
+#define BUS(v)		ssd_bus_enc(&ssd1963_bus, v)
+#define BUS_DC_MASK	ssd1963_bus.dc_mask
+#define BUS_WR_MASK	ssd1963_bus.wr_mask
+#define BUS_RD_MASK	ssd1963_bus.rd_mask
 
-/* fast bus access */
+#define BUS_MASK	ssd1963_bus.data_mask
+// #define BUS_CMD_MASK	BUS(0xff) /* commands are only 8 bit wide */
+#define BUS_CTL_MASK	(BUS_DC_MASK | BUS_WR_MASK | BUS_RD_MASK)
 
-static inline void ssd1963_bus_wr0(u32 d)
+static inline unsigned ssd1963_pdata_tiles(
+	const struct ssd1963_platform_data *pdata)
 {
-	/* __iowmb() would've been called at cmd submission time already and
-	 * ARM doesn't reorder writes to the same subsystem */
-	writel_relaxed((~d & BUS_MASK) | BUS_WR_MASK, GPIO_CLR_BANK0);
-	writel_relaxed(  d & BUS_MASK               , GPIO_SET_BANK0);
-	writel_relaxed(                  BUS_WR_MASK, GPIO_SET_BANK0);
+	return max_t(unsigned, pdata->tiles_x, 1) *
+	       max_t(unsigned, pdata->tiles_y, 1);
 }
 
-static inline void ssd1963_bus_wr(u32 v)
+static int ssd1963_bus_init(struct device *dev,
+			    const struct ssd1963_platform_data *pdata)
 {
-	ssd1963_bus_wr0(BUS(v));
-}
+	unsigned ntiles = ssd1963_pdata_tiles(pdata), pin, t, i, v;
+	struct ssd1963_platform_data tp;
+	const struct ssd_bus *b;
+	u32 used = 0, m;
+	int ret;
 
-static inline void ssd1963_wr_cmd(u8 x)
-{
-	ssd_wr_slow_cmd(x);
-}
+	if (ntiles > SSD1963_MAX_TILES) {
+		dev_err(dev, "%u panels, at most %u can be spanned\n", ntiles,
+			SSD1963_MAX_TILES);
+		return -EINVAL;
+	}
 
-static inline void ssd1963_wr_data(u8 x)
-{
-	ssd1963_bus_wr(x);
+	ret = ssd_bus_setup(&ssd1963_tile_bus[0], pdata, &pin);
+	for (t = 1; !ret && t < ntiles; t++) {
+		tp = *pdata;
+		memcpy(tp.data_pins, pdata->tile_pins[t-1].data_pins,
+		       sizeof(tp.data_pins));
+		tp.dc_pin = pdata->tile_pins[t-1].dc_pin;
+		tp.wr_pin = pdata->tile_pins[t-1].wr_pin;
+		tp.rd_pin = SSD1963_PIN_NONE;
+		ret = ssd_bus_setup(&ssd1963_tile_bus[t], &tp, &pin);
+	}
+	if (ret && pin == SSD1963_PIN_NONE)
+		dev_err(dev, "interface format %d needs %u data lines, only "
+			"%u are connected\n", pdata->bus_fmt,
+			ssd_bus_fmt_width(pdata->bus_fmt), pdata->bus_width);
+	else if (ret)
+		dev_err(dev, "invalid or duplicate bus pin %u\n", pin);
+	if (ret)
+		return ret;
+
+	ssd1963_bus = ssd1963_tile_bus[0];
+	for (t = 0; t < ntiles; t++) {
+		b = &ssd1963_tile_bus[t];
+		m = b->data_mask | b->dc_mask | b->wr_mask | b->rd_mask;
+		if (used & m) {
+			dev_err(dev, "panel %u shares bus pins 0x%08x\n", t,
+				used & m);
+			return -EINVAL;
+		}
+		used |= m;
+		if (!t)
+			continue;
+		ssd1963_bus.data_mask |= b->data_mask;
+		ssd1963_bus.dc_mask |= b->dc_mask;
+		ssd1963_bus.wr_mask |= b->wr_mask;
+		for (i = 0; i < ARRAY_SIZE(b->lut); i++)
+			for (v = 0; v < 256; v++)
+				ssd1963_bus.lut[i][v] |= b->lut[i][v];
+	}
+	return 0;
 }
-#else
+
+/* slow bus access */
+
 void ssd_wr_slow_data(u8 v)
 {
 	if (0)
 		print_debug("%02x\n", v);
+	ssd_bus_wr_slow_data(&ssd1963_bus, v);
 }
 
 void ssd_wr_slow_cmd(u8 v)
 {
 	if (0)
 		print_debug("%02x\n", v);
+	ssd_bus_wr_slow_cmd(&ssd1963_bus, v);
+}
+
+int ssd_rd_slow_data(void)
+{
+	return ssd_bus_rd_slow(&ssd1963_bus);
+}
+
+/* fast bus access */
+
+static inline void ssd1963_bus_wr0(u32 d)
+{
+	ssd_bus_wr0(&ssd1963_bus, d);
+}
+
+static inline void ssd1963_bus_strobe(void)
+{
+	ssd_bus_strobe(&ssd1963_bus);
 }
 
 static inline void ssd1963_bus_wr(u32 v)
 {
+	ssd1963_bus_wr0(BUS(v));
 }
 
 static inline void ssd1963_wr_cmd(u8 x)
 {
-	if (0)
-		print_debug("%02x\n", x);
+	ssd_wr_slow_cmd(x);
 }
 
 static inline void ssd1963_wr_data(u8 x)
 {
-	if (0)
-		print_debug("%02x", x);
+	ssd1963_bus_wr(x);
 }
-#endif
 
 #define SSD_WR_CMD(x)	ssd1963_wr_cmd(x)
 #define SSD_WR_DATA(x)	ssd1963_wr_data(x)
 
 #include "ssd1963_cmd.h"
 
+/* init scripts: commands on the slow, parameters on the fast path */
+static const struct ssd_bus_ops ssd1963_bus_ops = {
+	.wr_cmd  = ssd1963_wr_cmd,
+	.wr_data = ssd1963_wr_data,
+	.rd_data = ssd_rd_slow_data,
+};
+
 /* This is limited to 16 characters when displayed by X startup */
 static const char *ssd1963_name = "SSD1963 FB";
 
@@ -230,12 +481,81 @@ static int ssd1963_fb_set_bitfields(struct fb_var_screeninfo *var)
 	return 0;
 }
 
+/* FB_ROTATE_CW and FB_ROTATE_CCW exchange the panel's rows and columns */
+static inline int ssd1963_rotated_90(const struct fb_var_screeninfo *var)
+{
+	return var->rotate & 1;
+}
+
+/* Resolutions dividing the panel's by an integer factor in both directions
+ * are shown scaled up by it instead of on a smaller active area: the panel
+ * keeps its native timing and the senders replicate every pixel and line,
+ * see __ssd1963_send_rect(). Returns the factor, 1 if not scaled. */
+static u32 ssd1963_var_scale(const struct fb_var_screeninfo *var)
+{
+	u32 w = this_fb.pdata->lcd.hori.visible;
+	u32 h = this_fb.pdata->lcd.vert.visible;
+	u32 xres = ssd1963_rotated_90(var) ? var->yres : var->xres;
+	u32 yres = ssd1963_rotated_90(var) ? var->xres : var->yres;
+	u32 s;
+
+	if (!xres || !yres || xres >= w || this_fb.ntiles > 1)
+		return 1;
+	s = w / xres;
+	return xres * s == w && yres * s == h ? s : 1;
+}
+
+/* panel row to start the display at for the virtual screen's line y */
+static u32 ssd1963_scroll_start(const struct fb_var_screeninfo *var, u32 y)
+{
+	if (ssd1963_rotated_90(var))
+		return 0;
+	/* panel lines are in reverse order when upside down */
+	if (var->rotate == FB_ROTATE_UD && y)
+		y = var->yres - y;
+	return y * ssd1963_var_scale(var);
+}
+
+/* The controller rotates what the host writes, so windows, the shadow and
+ * the diff all stay in the rotated (logical) coordinates. */
+static u8 ssd1963_addr_mode(const struct fb_var_screeninfo *var)
+{
+	static const u8 rot[] = {
+		[FB_ROTATE_UR]  = 0,
+		[FB_ROTATE_CW]  = SSD_ADDR_HOST_PAGE_COL_EXCHANGE |
+		                  SSD_ADDR_HOST_HORI_REVERSE,
+		[FB_ROTATE_UD]  = SSD_ADDR_HOST_HORI_REVERSE |
+		                  SSD_ADDR_HOST_VERT_REVERSE,
+		[FB_ROTATE_CCW] = SSD_ADDR_HOST_PAGE_COL_EXCHANGE |
+		                  SSD_ADDR_HOST_VERT_REVERSE,
+	};
+	return this_fb.pdata->lcd_addr_mode ^ rot[var->rotate & 3];
+}
+
+/* The shadow and the last sent frame are stored in the var format, which is
+ * also what the bus encoders take. By default it is the narrowest holding
+ * the bus format's colors: 18 bit colors take 3 bytes, 565 two. The shadow
+ * is allocated for this many bits per pixel at the panel's resolution,
+ * clients can only select narrower formats later. */
+static unsigned bpp;
+module_param(bpp, uint, S_IRUGO);
+MODULE_PARM_DESC(bpp, "bits per pixel of the framebuffer and max. for "
+	"clients, 0: 16 for SSD_DATA_16_565, 24 otherwise (default: 0)");
+
+static u32 ssd1963_default_bpp(void)
+{
+	if (bpp)
+		return bpp;
+	return this_fb.pdata->bus_fmt == SSD_DATA_16_565 ? 16 : 24;
+}
+
 static int ssd1963_fb_check_var(struct fb_var_screeninfo *var,
 				struct fb_info *info)
 {
 	/* info input, var output */
 	enum ssd_err err;
 	int xres, yres;
+	u32 xres_virtual, yres_virtual;
 	u32 pclk;
 
 	print_debug("check_var info(%p) %dx%d (%dx%d), %d, %d\n", info,
@@ -247,9 +567,11 @@ static int ssd1963_fb_check_var(struct fb_var_screeninfo *var,
 		var->bits_per_pixel);
 
 	if (!var->bits_per_pixel)
-		var->bits_per_pixel = 16;
+		var->bits_per_pixel = ssd1963_default_bpp();
 
-	if (ssd1963_fb_set_bitfields(var) != 0) {
+	/* the shadow framebuffer needs whole bytes per pixel */
+	if (var->bits_per_pixel % 8 || var->bits_per_pixel > 32 ||
+	    ssd1963_fb_set_bitfields(var) != 0) {
 		pr_err("check_var: invalid bits_per_pixel %d\n",
 			var->bits_per_pixel);
 		return -EINVAL;
@@ -272,16 +594,35 @@ static int ssd1963_fb_check_var(struct fb_var_screeninfo *var,
 	if (1 || var->yres_virtual < var->yres)
 		var->yres_virtual = var->yres;
 
-	if (var->xres_virtual > SSD1963_MAX_WIDTH) {
+	if (var->rotate > FB_ROTATE_CCW) {
+		pr_err("ssd1963_fb_check_var: ERROR: invalid rotation %u\n",
+			var->rotate);
+		return -EINVAL;
+	}
+	if (this_fb.ntiles > 1 && var->rotate != FB_ROTATE_UR) {
+		pr_err("check_var: spanned panels cannot be rotated\n");
+		return -EINVAL;
+	}
+
+	/* the rest is in the panel's orientation */
+	if (ssd1963_rotated_90(var)) {
+		xres_virtual = var->yres_virtual;
+		yres_virtual = var->xres_virtual;
+	} else {
+		xres_virtual = var->xres_virtual;
+		yres_virtual = var->yres_virtual;
+	}
+
+	if (xres_virtual > SSD1963_MAX_WIDTH * this_fb.tiles_x) {
 		pr_err("ssd1963_fb_check_var: ERROR: virtual xres (%d) > max. "
 			"supported (%d)\n",
-			var->xres_virtual, SSD1963_MAX_WIDTH);
+			xres_virtual, SSD1963_MAX_WIDTH * this_fb.tiles_x);
 		return -EINVAL;
 	}
-	if (var->yres_virtual > SSD1963_MAX_HEIGHT) {
+	if (yres_virtual > SSD1963_MAX_HEIGHT * this_fb.tiles_y) {
 		pr_err("ssd1963_fb_check_var: ERROR: virtual yres (%d) > max. "
 			"supported (%d)\n",
-			var->yres_virtual, SSD1963_MAX_HEIGHT);
+			yres_virtual, SSD1963_MAX_HEIGHT * this_fb.tiles_y);
 		return -EINVAL;
 	}
 
@@ -291,8 +632,25 @@ static int ssd1963_fb_check_var(struct fb_var_screeninfo *var,
 	if (var->yoffset > var->yres_virtual - var->yres)
 		var->yoffset = var->yres_virtual - var->yres - 1;
 
-	xres = var->xres;
-	yres = var->yres;
+	if (ALIGN(var->bits_per_pixel / 8 * var->xres_virtual, 4) *
+	    var->yres_virtual > this_fb.shadow_size) {
+		pr_err("check_var: %u bpp need a larger shadow framebuffer, "
+			"see parameter bpp\n", var->bits_per_pixel);
+		return -EINVAL;
+	}
+
+	xres = ssd1963_rotated_90(var) ? var->yres : var->xres;
+	yres = ssd1963_rotated_90(var) ? var->xres : var->yres;
+	xres *= ssd1963_var_scale(var);
+	yres *= ssd1963_var_scale(var);
+	/* each spanned panel shows an equal part */
+	if (xres % this_fb.tiles_x || yres % this_fb.tiles_y) {
+		pr_err("check_var: %ux%u cannot be split onto %ux%u panels\n",
+			xres, yres, this_fb.tiles_x, this_fb.tiles_y);
+		return -EINVAL;
+	}
+	xres /= this_fb.tiles_x;
+	yres /= this_fb.tiles_y;
 	/*
 	if (var->vmode & FB_VMODE_DOUBLE)
 		yres *= 2;
@@ -351,6 +709,87 @@ static int ssd1963_fb_check_var(struct fb_var_screeninfo *var,
 	return 0;
 }
 
+/* Splits the var's resolution onto the spanned panels, with bus_lock held.
+ * The panels are in rows of tiles_x, each sent to by its own pipe. */
+static void ssd1963_tiles_set(struct ssd1963_fb *fb)
+{
+	unsigned t;
+
+	fb->tile_w = fb->info.var.xres / fb->tiles_x;
+	fb->tile_h = fb->info.var.yres / fb->tiles_y;
+	for (t = 0; t < fb->ntiles; t++) {
+		fb->pipes[t].bus = &ssd1963_tile_bus[t];
+		fb->pipes[t].x0 = t % fb->tiles_x * fb->tile_w;
+		fb->pipes[t].y0 = t / fb->tiles_x * fb->tile_h;
+	}
+}
+
+/* Turns off the display, (re)starts the PLL and soft-resets the controller,
+ * then sets the interface format. With bus_lock held. */
+static enum ssd_err ssd1963_hw_init_pll(struct ssd1963_fb *fb)
+{
+	struct ssd_script s = { .n = 0 };
+	enum ssd_err err;
+
+	err = ssd_script_pll(&s, &fb->iv);
+	if (!err) /* SET_PIXEL_DATA_INTERFACE */
+		err = SSD_SCRIPT_CMD(&s, SSD_SCRIPT_ALWAYS, 0, 0xf0,
+				     fb->pdata->bus_fmt);
+	if (err)
+		return err;
+
+	err = ssd_script_run(&ssd1963_bus_ops, &s, NULL);
+	if (err == SSD_ERR_PLL_UNSTABLE)
+		SSD_SET_PLL(0x00);
+	/* the reset lost all of set_par's registers */
+	fb->par_sent_valid = 0;
+	return err;
+}
+
+/* Programs the mode in info->var (and this_fb.iv), with bus_lock held. Only
+ * the commands differing from the last call are sent. */
+static enum ssd_err ssd1963_hw_set_par(struct fb_info *info)
+{
+	struct ssd1963_fb *fb = &this_fb;
+	struct ssd_script *s = &fb->par_script;
+	u16 vsa = fb->pdata->lcd.vert.visible;
+	u16 vsp = ssd1963_scroll_start(&info->var, info->var.yoffset);
+	unsigned ndisplay;
+	enum ssd_err err;
+
+	s->n = 0;
+	err = ssd_script_display(s, &fb->iv);
+	ndisplay = s->n;
+	if (!err) /* SET_ADDRESS_MODE */
+		err = SSD_SCRIPT_CMD(s, 0, 0, 0x36,
+				     ssd1963_addr_mode(&info->var));
+	if (!err) /* SET_SCROLL_AREA */
+		err = SSD_SCRIPT_CMD(s, 0, 0, 0x33, 0, 0, vsa >> 8, vsa, 0, 0);
+	if (!err) /* SET_SCROLL_START, also changed by pan_display */
+		err = SSD_SCRIPT_CMD(s, SSD_SCRIPT_ALWAYS, 0, 0x37,
+				     vsp >> 8, vsp);
+	if (err)
+		return err;
+
+#ifdef SSD1963_FB_DEBUG
+	ssd_script_print(s);
+#endif
+
+	/* taken over running with these timings, rewriting them may flicker */
+	if (fb->warm) {
+		fb->par_sent = *s;
+		fb->par_sent.n = ndisplay;
+		fb->par_sent_valid = 1;
+	}
+
+	err = ssd_script_run(&ssd1963_bus_ops, s,
+			     fb->par_sent_valid ? &fb->par_sent : NULL);
+	fb->par_sent = *s;
+	fb->par_sent_valid = err == SSD_ERR_NONE;
+	fb->line_ns = ssd_iv_get_line_ns(&fb->iv);
+	return err;
+}
+
 static int ssd1963_fb_set_par(struct fb_info *info)
 {
 	const struct ssd_init_vector *iv = &this_fb.iv;
@@ -363,21 +802,50 @@ static int ssd1963_fb_set_par(struct fb_info *info)
 
 	ssd_iv_print(iv);
 
-	err = ssd_init_display(iv);
+	ssd1963_fb_sync(info);
+	mutex_lock(&this_fb.bus_lock);
+	err = ssd1963_hw_set_par(info);
 	print_debug("init_display: %s\n", ssd_strerr(err));
-
-	SSD_SET_SCROLL_AREA(0, info->var.yres, 0);
+	ssd1963_tiles_set(&this_fb);
+	mutex_unlock(&this_fb.bus_lock);
+
+	/* scrolling moves panel lines, which are columns when rotated by 90
+	 * degrees, so ywrap is only available otherwise; spanned panels all
+	 * scroll the same lines, which only matches the framebuffer's in a
+	 * single row of them */
+	if (ssd1963_rotated_90(&info->var) || this_fb.tiles_y > 1) {
+		info->flags &= ~FBINFO_HWACCEL_YWRAP;
+		info->fix.ywrapstep = 0;
+	} else {
+		info->flags |= FBINFO_HWACCEL_YWRAP;
+		info->fix.ywrapstep = 1;
+	}
 
 	if (info->var.bits_per_pixel <= 8)
 		this_fb.info.fix.visual = FB_VISUAL_PSEUDOCOLOR;
 	else
 		this_fb.info.fix.visual = FB_VISUAL_TRUECOLOR;
 
-	/* ensure fb_read/fb_write get called by fbmem */
-	this_fb.info.screen_base = (__iomem char *)1;
-	this_fb.info.fix.line_length = (this_fb.info.var.bits_per_pixel + 7) / 8 * this_fb.info.var.xres_virtual;
+	this_fb.scale = ssd1963_var_scale(&info->var);
+
+	/* lines are word aligned for ssd1963_diff_line() */
+	this_fb.info.screen_base = (char __iomem *)this_fb.shadow;
+	this_fb.info.fix.smem_start = (unsigned long)this_fb.shadow;
+	this_fb.info.fix.smem_len = this_fb.shadow_size;
+	this_fb.info.fix.line_length = ALIGN(this_fb.info.var.bits_per_pixel / 8 * this_fb.info.var.xres_virtual, 4);
 	this_fb.info.screen_size = this_fb.info.fix.line_length * this_fb.info.var.yres_virtual;
 
+	if (info->var.bits_per_pixel <= 8)
+		this_fb.px_mask = (1 << info->var.bits_per_pixel) - 1;
+	else
+		this_fb.px_mask = (1 << (info->var.red.length +
+					 info->var.green.length +
+					 info->var.blue.length)) - 1;
+
+	/* GRAM was reinterpreted, possibly in a different format, and prev's
+	 * lines may be of the old line_length */
+	ssd1963_shadow_invalidate(&this_fb);
+
 	return 0;
 }
 
@@ -389,58 +857,56 @@ static int ssd1963_fb_set_par(struct fb_info *info)
  * SSD_DATA_18       : [rgb].length >= 666, bpp >= 18 (24)
  * SSD_DATA_24       : [rgb].length >= 888, bpp >= 24 */
 
-static struct ssd1963_px_wr {
-	u8 color1;
-	u8 color1_valid : 1;
-} wr;
+static struct ssd_px_state wr;
 
-static void ssd1963_px_flush(void)
-{
-	if (this_fb.pdata->bus_fmt == SSD_DATA_16_PACKED && wr.color1_valid) {
-		ssd1963_bus_wr((wr.color1 << 8) & 0xff00);
-		wr.color1_valid = !wr.color1_valid;
-	}
-}
+/* The encoders (see ssd1963_bus.h) translate a color into the GPIO words to be
+ * put on the bus, returning their count; the writers below send them. */
+#define SSD1963_PX_MAX_WORDS	SSD_PX_MAX_WORDS
 
-#if 1
-static inline void ssd1963_px_wr8(u32 color)
+static unsigned ssd1963_px_enc_flush(u32 *w)
 {
-	ssd1963_bus_wr(color >> 16);
-	ssd1963_bus_wr(color >>  8);
-	ssd1963_bus_wr(color);
+	return ssd_px_enc_flush(ssd1963_enc_bus, &wr, w);
 }
 
-static inline void ssd1963_px_wr9(u32 color)
+static inline void ssd1963_bus_wr_words(const u32 *w, unsigned n)
 {
-	ssd1963_bus_wr(color >> 9);
-	ssd1963_bus_wr(color);
+	ssd_bus_wr_words(&ssd1963_bus, w, n);
 }
 
-static inline void ssd1963_px_wr12(u32 color)
+static void ssd1963_px_flush(void)
 {
-	ssd1963_bus_wr(color >> 12);
-	ssd1963_bus_wr(color);
+	u32 w[1];
+	ssd1963_bus_wr_words(w, ssd1963_px_enc_flush(w));
 }
 
-static inline void ssd1963_px_wr16_packed(u32 color)
-{
-	if (wr.color1_valid) {
-		ssd1963_bus_wr(
-			((u16)wr.color1 << 8) |
-			((color >> 16) & 0x00ff));
-		ssd1963_bus_wr(color);
-	} else {
-		ssd1963_bus_wr(color >> 8);
-		wr.color1 = color;
-	}
-	wr.color1_valid = !wr.color1_valid;
+#if 1
+#define SSD1963_PX_ENC(fmt) \
+static inline unsigned ssd1963_px_enc##fmt(u32 *w, u32 color) \
+{ \
+	return ssd_px_enc##fmt(ssd1963_enc_bus, &wr, w, color); \
 }
 
-static inline void ssd1963_px_wr1(u32 color)
-{
-	ssd1963_bus_wr(color);
+SSD1963_PX_ENC(8)
+SSD1963_PX_ENC(9)
+SSD1963_PX_ENC(12)
+SSD1963_PX_ENC(16_packed)
+SSD1963_PX_ENC(1)
+
+#define SSD1963_PX_WR(fmt) \
+static void ssd1963_px_wr##fmt(u32 color) \
+{ \
+	u32 w[SSD1963_PX_MAX_WORDS]; \
+	ssd1963_bus_wr_words(w, ssd1963_px_enc##fmt(w, color)); \
 }
 
+SSD1963_PX_WR(8)
+SSD1963_PX_WR(9)
+SSD1963_PX_WR(12)
+SSD1963_PX_WR(16_packed)
+SSD1963_PX_WR(1)
+
+static unsigned (*ssd1963_px_enc)(u32 *w, u32 color);
+
 static void (*ssd1963_px_wr)(u32 color);
 // #define ssd1963_px_wr(c)	ssd1963_px_wr8(c)
 #else
@@ -481,181 +947,2281 @@ static inline void ssd1963_px_wr(enum ssd_interface_fmt bus_fmt, u32 color)
 }
 #endif
 
-static void ssd1963_fb_fillrect(struct fb_info *p, const struct fb_fillrect *rect)
+/* Sends n pixels of the same color. If a pixel is encoded into identical
+ * words (single word formats, gray on SSD_DATA_8), all but the first word are
+ * just #WR strobes. */
+static void ssd1963_px_rep(u32 color, u32 n)
 {
-	u32 c = rect->color;
-	u32 n;
+	u32 w[SSD1963_PX_MAX_WORDS];
+	unsigned k, i;
 
-	if (p->state != FBINFO_STATE_RUNNING)
+	if (!n)
 		return;
+	if (this_fb.pdata->bus_fmt == SSD_DATA_16_PACKED) {
+		while (n--)
+			ssd1963_px_wr(color);
+		return;
+	}
 
-	if (rect->rop != ROP_COPY)
-		printk(KERN_ERR MODULE_NAME " fillrect: unknown rop: %d, "
-			"defaulting to ROP_COPY\n",
-			rect->rop);
+	k = ssd1963_px_enc(w, color);
+	for (i = 1; i < k && w[i] == w[0]; i++);
+	if (i < k) {
+		while (n--)
+			ssd1963_bus_wr_words(w, k);
+		return;
+	}
 
-	if (p->fix.visual == FB_VISUAL_TRUECOLOR ||
-	    p->fix.visual == FB_VISUAL_DIRECTCOLOR)
-		c = ((u32 *)p->pseudo_palette)[c];
-/*
-	print_debug("rect %ux%u @ %u,%u w/ color %08x\n",
-		rect->width, rect->height, rect->dx, rect->dy, rect->color);
-*/
-	SSD_SET_PAGE_ADDRESS(rect->dy, rect->dy + rect->height - 1);
-	SSD_SET_COLUMN_ADDRESS(rect->dx, rect->dx + rect->width - 1);
-	SSD_WRITE_MEMORY_START();
+	ssd1963_bus_wr0(w[0]);
+	for (n = n * k - 1; n; n--)
+		ssd1963_bus_strobe();
+}
 
-	wr.color1_valid = 0;
-	for (n = rect->width * rect->height; n; n--)
-		ssd1963_px_wr(c);
-	ssd1963_px_flush();
+/* like ssd1963_px_rep(), but appends the words to p */
+static u32 * ssd1963_px_rep_enc(u32 *p, u32 color, u32 n)
+{
+	u32 w[SSD1963_PX_MAX_WORDS];
+	unsigned k;
+
+	if (!n)
+		return p;
+	if (this_fb.pdata->bus_fmt == SSD_DATA_16_PACKED) {
+		while (n--)
+			p += ssd1963_px_enc(p, color);
+		return p;
+	}
+
+	k = ssd1963_px_enc(w, color);
+	while (n--) {
+		memcpy(p, w, k * sizeof(u32));
+		p += k;
+	}
+	return p;
 }
 
-static void ssd1963_fb_imageblit(struct fb_info *p, const struct fb_image *image)
+/* For each byte value, the lengths of the runs of equal bits starting at the
+ * MSB, terminated by 0. */
+static u8 ssd1963_bit_runs[256][9];
+
+static void ssd1963_bit_runs_init(void)
 {
-	const u8 *src = image->data;
-	const u32 *palette = (u32 *)p->pseudo_palette;
-	u32 color;
+	unsigned b, i, n;
+
+	for (b = 0; b < 256; b++) {
+		u8 *r = ssd1963_bit_runs[b];
+		for (i = 7, n = 1; i; i--, n++) {
+			if (!(b >> i & 1) != !(b >> (i - 1) & 1)) {
+				*r++ = n;
+				n = 0;
+			}
+		}
+		*r++ = n;
+		*r = 0;
+	}
+}
 
-	if (p->state != FBINFO_STATE_RUNNING)
-		return;
-/*
-	print_debug("img %ux%u @ %u,%u w/ depth %d, color fg/bg %08x / %08x, cmap: %d %d\n",
-		image->width, image->height, image->dx, image->dy,
-		image->depth, fg, bg, image->cmap.start, image->cmap.len);
-*/
-	SSD_SET_PAGE_ADDRESS(image->dy, image->dy + image->height - 1);
-	SSD_SET_COLUMN_ADDRESS(image->dx, image->dx + image->width - 1);
-	SSD_WRITE_MEMORY_START();
+/* Expands the 1 bpp bitmap src a source byte at a time into runs of fg and bg
+ * pixels. Runs continue across byte and line boundaries since the window is
+ * written as a single stream. Pixels are sent to the bus if enc is NULL,
+ * otherwise appended to *enc. */
+static void ssd1963_blit1_expand(const u8 *src, u16 width, u16 height,
+				 u32 fg, u32 bg, u32 **enc)
+{
+	u32 spitch = (width + 7) / 8;
+	u32 run = 0;
+	int bit = 0;
+	u32 y, x;
 
 	wr.color1_valid = 0;
-	if (image->depth == 1) {
-		u32 spitch = (image->width + 7) / 8;
-		u32 fg = image->fg_color, bg = image->bg_color;
-		u32 y, x;
-		if (p->fix.visual == FB_VISUAL_TRUECOLOR ||
-		    p->fix.visual == FB_VISUAL_DIRECTCOLOR) {
-			fg = palette[fg];
-			bg = palette[bg];
-		}
-		for (y = image->height; y; y--, src += spitch) {
-			const u8 *s = src;
-			u8 l = 8, v = *s;
-			for (x = image->width; x; x--) {
-				ssd1963_px_wr(v & (1 << --l) ? fg : bg);
-				if (!l) {
-					v = *++s;
-					l = 8;
+	for (y = height; y; y--, src += spitch) {
+		const u8 *s = src;
+		for (x = width; x; s++) {
+			unsigned nbits = min(x, 8u);
+			const u8 *r = ssd1963_bit_runs[*s];
+			int b = *s >> 7;
+
+			x -= nbits;
+			for (; nbits && *r; r++, b = !b) {
+				unsigned len = min_t(unsigned, *r, nbits);
+				nbits -= len;
+				if (b == bit) {
+					run += len;
+					continue;
 				}
+				if (enc)
+					*enc = ssd1963_px_rep_enc(*enc,
+						bit ? fg : bg, run);
+				else
+					ssd1963_px_rep(bit ? fg : bg, run);
+				bit = b;
+				run = len;
 			}
 		}
+	}
+	if (enc) {
+		*enc = ssd1963_px_rep_enc(*enc, bit ? fg : bg, run);
+		*enc += ssd1963_px_enc_flush(*enc);
 	} else {
-		u32 n;
-		for (n = image->dx * image->dy; n; n--, src++) {
-			if (p->fix.visual == FB_VISUAL_TRUECOLOR ||
-			    p->fix.visual == FB_VISUAL_DIRECTCOLOR)
-				color = palette[*src];
-			else
-				color = *src;
-			ssd1963_px_wr(color);
-		}
+		ssd1963_px_rep(bit ? fg : bg, run);
+		ssd1963_px_flush();
 	}
-	ssd1963_px_flush();
 }
-/*
-static struct {
-	unsigned sleep   : 1;
-	unsigned idle    : 1;
-	unsigned partial : 1;
-	unsigned display : 1;
-} ssd1963_mode;
-*/
-static int ssd1963_fb_blank(int blank, struct fb_info *info)
+
+/* --------------------------------------------------------------------------
+ * command queue
+ * -------------------------------------------------------------------------- */
+
+static inline unsigned ssd1963_op_pending(const struct ssd1963_fb *fb)
 {
-	print_debug("blank: %d\n", blank);
-	switch (blank) {
-	case FB_BLANK_UNBLANK:
-		SSD_EXIT_SLEEP_MODE();
-		msleep(5);
-		break;
-	case FB_BLANK_NORMAL:
-		SSD_SET_DISPLAY_OFF();
-		break;
-	case FB_BLANK_POWERDOWN:
-		SSD_ENTER_SLEEP_MODE();
-		msleep(5);
-		break;
-	default:
-		return 1;
-	}
-	return 0;
+	return fb->op_head - fb->op_tail;
 }
 
-static inline u32 convert_bitfield(int val, struct fb_bitfield *bf)
+static inline int ssd1963_may_sleep(void)
 {
-	unsigned int mask = (1 << bf->length) - 1;
-	return (val >> (16 - bf->length) & mask) << bf->offset;
+	return !in_atomic() && !irqs_disabled();
 }
 
-static int ssd1963_fb_setcolreg(unsigned int regno, unsigned int red,
-				unsigned int green, unsigned int blue,
-				unsigned int transp, struct fb_info *info)
+/* Op data is allocated atomically if possible; large images (e.g. a boot
+ * splash) are allocated by vmalloc() when the caller may sleep. */
+static void * ssd1963_op_alloc(size_t size)
 {
-	print_debug("setcolreg %d:(%02x,%02x,%02x,%02x) %x\n",
-		regno, red, green, blue, transp, info->fix.visual);
-	if (info->var.bits_per_pixel <= 8) {
-		if (0 && regno < 256) {
-			/* blue [0:4], green [5:10], red [11:15] */
-			/*
-			info->cmap[regno] = ((red   >> (16-5)) & 0x1f) << 11 |
-					    ((green >> (16-6)) & 0x3f) << 5  |
-					    ((blue  >> (16-5)) & 0x1f) << 0;*/
-		}
-		/* Hack: we need to tell GPU the palette has changed, but currently bcm2708_fb_set_par takes noticable time when called for every (256) colour */
-		/* So just call it for what looks like the last colour in a list for now. */
-		if (regno == 15 || regno == 255)
-			ssd1963_fb_set_par(info);
-        } else if (regno < 16) {
-		this_fb.cmap[regno] =
-			convert_bitfield(transp, &info->var.transp) |
-			convert_bitfield(blue, &info->var.blue)     |
-			convert_bitfield(green, &info->var.green)   |
-			convert_bitfield(red, &info->var.red);
-	}
-	return regno > 255;
+	void *p = NULL;
+
+	if (size <= PAGE_SIZE || !ssd1963_may_sleep())
+		p = kmalloc(size, GFP_ATOMIC | __GFP_NOWARN);
+	if (!p && ssd1963_may_sleep())
+		p = vmalloc(size);
+	return p;
 }
 
-static int ssd1963_fb_pan_display(struct fb_var_screeninfo *var,
-				  struct fb_info *info)
+static void ssd1963_op_free(void *p)
 {
-	// print_debug("yoff: %u\n", var->yoffset);
-	SSD_SET_SCROLL_START(var->yoffset);
+	if (is_vmalloc_addr(p))
+		vfree(p);
+	else
+		kfree(p);
+}
+
+/* Schedules lines [y,y+h) of the shadow for the next flush. If unknown, the
+ * controller's copy of the lines is considered lost and they are resent
+ * completely. */
+static void ssd1963_damage(struct ssd1963_fb *fb, u32 y, u32 h, int unknown)
+{
+	unsigned long flags;
+
+	if (y >= SSD1963_MAX_LINES || !h)
+		return;
+	h = min(h, SSD1963_MAX_LINES - y);
+	spin_lock_irqsave(&fb->op_lock, flags);
+	if (unknown)
+		bitmap_clear(fb->line_known, y, h);
+	bitmap_set(fb->dirty, y, h);
+	spin_unlock_irqrestore(&fb->op_lock, flags);
+	wake_up(&fb->op_wq);
+}
+
+/* Returns 1 when op could be queued, 0 if it was dropped because the ring is
+ * full and the caller isn't allowed to sleep (e.g. printk() from an atomic
+ * context). In the latter case op->data is freed and, since the op's pixels
+ * are already in the shadow, its lines are left to the flush. */
+static int ssd1963_queue_op(struct ssd1963_fb *fb, const struct ssd1963_op *op)
+{
+	unsigned long flags;
+	int may_sleep = ssd1963_may_sleep();
+
+	spin_lock_irqsave(&fb->op_lock, flags);
+	while (ssd1963_op_pending(fb) == SSD1963_OP_RING) {
+		if (!may_sleep || !fb->worker) {
+			fb->op_dropped++;
+			spin_unlock_irqrestore(&fb->op_lock, flags);
+			if (op->type == SSD1963_OP_SCROLL)
+				pr_warn_ratelimited(MODULE_NAME ": queue full, "
+					"dropping scroll to %u\n", op->y);
+			else
+				ssd1963_damage(fb, op->y, op->h, 1);
+			ssd1963_op_free(op->data);
+			return 0;
+		}
+		spin_unlock_irqrestore(&fb->op_lock, flags);
+		wait_event(fb->done_wq,
+			ssd1963_op_pending(fb) < SSD1963_OP_RING);
+		spin_lock_irqsave(&fb->op_lock, flags);
+	}
+	fb->ops[fb->op_head % SSD1963_OP_RING] = *op;
+	fb->op_head++;
+	spin_unlock_irqrestore(&fb->op_lock, flags);
+
+	wake_up(&fb->op_wq);
+	return 1;
+}
+
+/* --------------------------------------------------------------------------
+ * glyph cache
+ * -------------------------------------------------------------------------- */
+
+static unsigned glyph_cache_entries = 512;
+module_param(glyph_cache_entries, uint, S_IRUGO);
+MODULE_PARM_DESC(glyph_cache_entries,
+	"max. number of cached glyphs, 0 disables the cache (default: 512)");
+
+static unsigned glyph_cache_kb = 1024;
+module_param(glyph_cache_kb, uint, S_IRUGO);
+MODULE_PARM_DESC(glyph_cache_kb,
+	"max. memory used by the glyph cache in KiB (default: 1024)");
+
+/* encoding buffer for a glyph of maximal size */
+static u32 ssd1963_glyph_scratch[SSD1963_GLYPH_MAX_PX * SSD1963_PX_MAX_WORDS + 1];
+
+static void ssd1963_glyph_init(struct ssd1963_glyph_cache *gc)
+{
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(gc->hash); i++)
+		INIT_HLIST_HEAD(&gc->hash[i]);
+	INIT_LIST_HEAD(&gc->lru);
+	gc->entries = 0;
+	gc->bytes = 0;
+}
+
+static size_t ssd1963_glyph_size(const struct ssd1963_glyph *g)
+{
+	return sizeof(*g) + g->nwords * sizeof(u32) + (g->w + 7) / 8 * g->h;
+}
+
+static void ssd1963_glyph_evict(struct ssd1963_glyph_cache *gc,
+				struct ssd1963_glyph *g)
+{
+	hlist_del(&g->node);
+	list_del(&g->lru);
+	gc->entries--;
+	gc->bytes -= ssd1963_glyph_size(g);
+	kfree(g);
+}
+
+static void ssd1963_glyph_clear(struct ssd1963_glyph_cache *gc)
+{
+	struct ssd1963_glyph *g, *tmp;
+
+	list_for_each_entry_safe(g, tmp, &gc->lru, lru)
+		ssd1963_glyph_evict(gc, g);
+}
+
+/* Encodes the 1 bpp bitmap src into GPIO words, starting and ending at a
+ * pixel boundary of the bus format. w must have room for
+ * width * height * SSD1963_PX_MAX_WORDS + 1 words. */
+static unsigned ssd1963_blit1_encode(u32 *w, const u8 *src,
+				     u16 width, u16 height, u32 fg, u32 bg)
+{
+	u32 *p = w;
+
+	ssd1963_blit1_expand(src, width, height, fg, bg, &p);
+
+	return p - w;
+}
+
+/* Returns the cached encoding of the 1 bpp op, creating it on a miss. NULL is
+ * returned if the cache is disabled, the op too large to be cached or no
+ * memory is available. */
+static struct ssd1963_glyph * ssd1963_glyph_get(struct ssd1963_glyph_cache *gc,
+						const struct ssd1963_op *op)
+{
+	enum ssd_interface_fmt bus_fmt = this_fb.pdata->bus_fmt;
+	u32 len = (op->w + 7) / 8 * op->h;
+	struct hlist_head *bucket;
+	struct hlist_node *pos;
+	struct ssd1963_glyph *g;
+	unsigned nwords;
+	size_t size;
+	u32 hash;
+
+	if (!glyph_cache_entries || (u32)op->w * op->h > SSD1963_GLYPH_MAX_PX)
+		return NULL;
+	/* too big for the cache even if encoded into the most words */
+	size = sizeof(*g) + len + sizeof(u32) *
+	       ((u32)op->w * op->h * SSD1963_PX_MAX_WORDS + 1);
+	if (size > glyph_cache_kb * 1024)
+		return NULL;
+
+	hash = jhash(op->data, len,
+		     jhash_3words((u32)op->w << 16 | op->h, op->fg,
+				  op->bg ^ bus_fmt, 0));
+	bucket = &gc->hash[hash & (ARRAY_SIZE(gc->hash) - 1)];
+
+	hlist_for_each_entry(g, pos, bucket, node) {
+		if (g->hash != hash || g->w != op->w || g->h != op->h ||
+		    g->fg != op->fg || g->bg != op->bg ||
+		    g->bus_fmt != bus_fmt || memcmp(g->bitmap, op->data, len))
+			continue;
+		gc->hits++;
+		list_move(&g->lru, &gc->lru);
+		return g;
+	}
+
+	gc->misses++;
+	nwords = ssd1963_blit1_encode(ssd1963_glyph_scratch, op->data,
+				      op->w, op->h, op->fg, op->bg);
+	size = sizeof(*g) + nwords * sizeof(u32) + len;
+
+	while (!list_empty(&gc->lru) &&
+	       (gc->entries >= glyph_cache_entries ||
+	        gc->bytes + size > glyph_cache_kb * 1024)) {
+		ssd1963_glyph_evict(gc, list_entry(gc->lru.prev,
+						   struct ssd1963_glyph, lru));
+		gc->evictions++;
+	}
+
+	g = kmalloc(size, GFP_KERNEL);
+	if (!g)
+		return NULL;
+
+	g->hash = hash;
+	g->w = op->w;
+	g->h = op->h;
+	g->fg = op->fg;
+	g->bg = op->bg;
+	g->bus_fmt = bus_fmt;
+	g->nwords = nwords;
+	memcpy(g->words, ssd1963_glyph_scratch, nwords * sizeof(u32));
+	g->bitmap = (u8 *)(g->words + nwords);
+	memcpy(g->bitmap, op->data, len);
+
+	hlist_add_head(&g->node, bucket);
+	list_add(&g->lru, &gc->lru);
+	gc->entries++;
+	gc->bytes += size;
+
+	return g;
+}
+
+#define SSD1963_GLYPH_ATTR(name, fmt) \
+static ssize_t ssd1963_glyph_##name##_show(struct device *dev, \
+					   struct device_attribute *attr, \
+					   char *buf) \
+{ \
+	return snprintf(buf, PAGE_SIZE, fmt "\n", this_fb.glyphs.name); \
+} \
+static DEVICE_ATTR(name, S_IRUGO, ssd1963_glyph_##name##_show, NULL)
+
+SSD1963_GLYPH_ATTR(entries, "%u");
+SSD1963_GLYPH_ATTR(bytes, "%zu");
+SSD1963_GLYPH_ATTR(hits, "%lu");
+SSD1963_GLYPH_ATTR(misses, "%lu");
+SSD1963_GLYPH_ATTR(evictions, "%lu");
+
+/* any write drops all cached glyphs and resets the statistics */
+static ssize_t ssd1963_glyph_clear_store(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	struct ssd1963_glyph_cache *gc = &this_fb.glyphs;
+
+	mutex_lock(&this_fb.bus_lock);
+	ssd1963_glyph_clear(gc);
+	gc->hits = gc->misses = gc->evictions = 0;
+	mutex_unlock(&this_fb.bus_lock);
+
+	return count;
+}
+static DEVICE_ATTR(clear, S_IWUSR, NULL, ssd1963_glyph_clear_store);
+
+static struct attribute *ssd1963_glyph_attrs[] = {
+	&dev_attr_entries.attr,
+	&dev_attr_bytes.attr,
+	&dev_attr_hits.attr,
+	&dev_attr_misses.attr,
+	&dev_attr_evictions.attr,
+	&dev_attr_clear.attr,
+	NULL,
+};
+
+static const struct attribute_group ssd1963_glyph_attr_group = {
+	.name = "glyph_cache",
+	.attrs = ssd1963_glyph_attrs,
+};
+
+/* the color to send for a pixel of the var format */
+static inline u32 ssd1963_px_color(u32 px)
+{
+	if (this_fb.info.var.bits_per_pixel <= 8)
+		return this_fb.lut[px & 0xff];
+	return px;
+}
+
+static void ssd1963_exec_fill(const struct ssd1963_op *op)
+{
+	u32 s = this_fb.scale;
+
+	SSD_SET_PAGE_ADDRESS(op->y * s, (op->y + op->h) * s - 1);
+	SSD_SET_COLUMN_ADDRESS(op->x * s, (op->x + op->w) * s - 1);
+	SSD_WRITE_MEMORY_START();
+
+	wr.color1_valid = 0;
+	ssd1963_px_rep(ssd1963_px_color(op->fg), (u32)op->w * op->h * s * s);
+	ssd1963_px_flush();
+}
+
+static void ssd1963_exec_blit(const struct ssd1963_op *op)
+{
+	struct ssd1963_glyph *g = NULL;
+	struct ssd1963_op o = *op;
+
+	/* glyphs are cached by the colors sent */
+	o.fg = ssd1963_px_color(op->fg);
+	o.bg = ssd1963_px_color(op->bg);
+	if ((u32)o.w * o.h <= SSD1963_GLYPH_MAX_PX)
+		g = ssd1963_glyph_get(&this_fb.glyphs, &o);
+
+	SSD_SET_PAGE_ADDRESS(o.y, o.y + o.h - 1);
+	SSD_SET_COLUMN_ADDRESS(o.x, o.x + o.w - 1);
+	SSD_WRITE_MEMORY_START();
+
+	if (g)
+		ssd1963_bus_wr_words(g->words, g->nwords);
+	else
+		ssd1963_blit1_expand(o.data, o.w, o.h, o.fg, o.bg, NULL);
+}
+
+static void ssd1963_exec_window(const struct ssd1963_op *op)
+{
+	const u32 *src = op->data;
+	u32 n;
+
+	SSD_SET_PAGE_ADDRESS(op->y, op->y + op->h - 1);
+	SSD_SET_COLUMN_ADDRESS(op->x, op->x + op->w - 1);
+	SSD_WRITE_MEMORY_START();
+
+	wr.color1_valid = 0;
+	for (n = (u32)op->w * op->h; n; n--)
+		ssd1963_px_wr(ssd1963_px_color(*src++));
+	ssd1963_px_flush();
+}
+
+/* --------------------------------------------------------------------------
+ * shadow framebuffer and frame-diff flush
+ * -------------------------------------------------------------------------- */
+
+/* Setting up a window takes SET_PAGE_ADDRESS, SET_COLUMN_ADDRESS and
+ * WRITE_MEMORY_START, i.e. 3 commands and 8 parameters on the slow path, each
+ * about as expensive as 3 words on the fast one. Unchanged gaps cheaper to
+ * resend than that are sent along with the changes around them. */
+#define SSD1963_WINDOW_COST	33 /* GPIO words */
+#define SSD1963_MAX_SPANS	16 /* per line, further changes are merged */
+
+/* Dirty lines examined per flush chunk, which bounds the time queued ops
+ * wait for the bus to about 16 full lines' transfer. Ops larger than that
+ * are not queued but flushed as damage, see ssd1963_shadow_submit(). */
+#define SSD1963_FLUSH_CHUNK	16
+
+struct ssd1963_span {
+	u32 x0, x1;
+};
+
+/* twice the number of GPIO words per pixel */
+static unsigned ssd1963_px_words2(void)
+{
+	switch (this_fb.pdata->bus_fmt) {
+	case SSD_DATA_8:		return 6;
+	case SSD_DATA_9:		return 4;
+	case SSD_DATA_12:
+	case SSD_DATA_16_PACKED:	return 3;
+	default:			return 2;
+	}
+}
+
+static __always_inline u32 ssd1963_shadow_px(const u8 *p, u32 Bpp)
+{
+	switch (Bpp) {
+	case 1: return *p;
+	case 2: return *(const u16 *)p;
+	case 3: return p[0] | p[1] << 8 | p[2] << 16;
+	default: return *(const u32 *)p;
+	}
+}
+
+static inline void ssd1963_shadow_put(u8 *p, u32 Bpp, u32 px)
+{
+	switch (Bpp) {
+	case 1: *p = px; break;
+	case 2: *(u16 *)p = px; break;
+	case 3: p[0] = px; p[1] = px >> 8; p[2] = px >> 16; break;
+	default: *(u32 *)p = px; break;
+	}
+}
+
+/* 8 bpp shadows hold palette indices */
+static __always_inline u32 ssd1963_rect_color(const struct ssd1963_fb *fb,
+					      u32 px, const u32 Bpp)
+{
+	return Bpp == 1 ? fb->lut[px] : px;
+}
+
+/* sends a run of n pixels of the shadow's color c */
+static __always_inline void ssd1963_rect_run(const struct ssd1963_fb *fb,
+					     u32 c, u32 n, const u32 Bpp)
+{
+	if (n == 1)
+		ssd1963_px_wr(ssd1963_rect_color(fb, c, Bpp));
+	else
+		ssd1963_px_rep(ssd1963_rect_color(fb, c, Bpp), n);
+}
+
+/* Sends a rect of the last transferred frame, which for all lines sent so far
+ * is what the controller is supposed to show. Runs of equal pixels only
+ * strobe WR where the bus format allows. Instantiated per shadow format by
+ * ssd1963_send_rect(), so pixels are read without dispatching on Bpp. In
+ * scaled modes each line is sent scale times with every pixel counting
+ * scale times towards its run, so replicated pixels are strobes, too. */
+static __always_inline void __ssd1963_send_rect(struct ssd1963_fb *fb, u32 x,
+						u32 y, u32 w, u32 h,
+						const u32 Bpp)
+{
+	u32 ll = fb->info.fix.line_length, sc = fb->scale;
+	u32 mask = fb->px_mask, c = 0, n = 0, px, i, r;
+	const u8 *p;
+
+	SSD_SET_PAGE_ADDRESS(y * sc, (y + h) * sc - 1);
+	SSD_SET_COLUMN_ADDRESS(x * sc, (x + w) * sc - 1);
+	SSD_WRITE_MEMORY_START();
+
+	wr.color1_valid = 0;
+	for (; h; h--, y++) {
+		for (r = 0; r < sc; r++) {
+			p = fb->prev + y * ll + x * Bpp;
+			for (i = 0; i < w; i++, p += Bpp) {
+				px = ssd1963_shadow_px(p, Bpp) & mask;
+				if (n && px == c) {
+					n += sc;
+					continue;
+				}
+				ssd1963_rect_run(fb, c, n, Bpp);
+				c = px;
+				n = sc;
+			}
+		}
+	}
+	ssd1963_rect_run(fb, c, n, Bpp);
+	ssd1963_px_flush();
+}
+
+static void ssd1963_send_rect(struct ssd1963_fb *fb, u32 x, u32 y, u32 w,
+			      u32 h)
+{
+	switch (fb->info.var.bits_per_pixel / 8) {
+	case 1: __ssd1963_send_rect(fb, x, y, w, h, 1); break;
+	case 2: __ssd1963_send_rect(fb, x, y, w, h, 2); break;
+	case 3: __ssd1963_send_rect(fb, x, y, w, h, 3); break;
+	default: __ssd1963_send_rect(fb, x, y, w, h, 4); break;
+	}
+}
+
+/* --------------------------------------------------------------------------
+ * encoder/emitter pipeline
+ * -------------------------------------------------------------------------- */
+
+/* Encoding a pixel (format conversion, lookup of the GPIO masks) costs about
+ * as much CPU time as the stores putting it on the bus. With several CPUs the
+ * flush only encodes the rects into buffers of GPIO words, which an emitter
+ * thread pinned to its own CPU streams out meanwhile. The flush drains the
+ * ring before releasing bus_lock. */
+static bool pipeline = 1;
+module_param(pipeline, bool, S_IRUGO);
+MODULE_PARM_DESC(pipeline, "encode pixels and drive the bus on separate CPUs "
+	"if there are several (default: 1)");
+
+static int pipe_cpu = -1;
+module_param(pipe_cpu, int, S_IRUGO);
+MODULE_PARM_DESC(pipe_cpu, "CPU to run the emitter on (default: -1, the last "
+	"online one)");
+
+static bool pipe_fifo;
+module_param(pipe_fifo, bool, S_IRUGO);
+MODULE_PARM_DESC(pipe_fifo, "run the emitter as SCHED_FIFO (default: 0)");
+
+/* iterations the emitter polls for the next buffer before sleeping */
+#define SSD1963_PIPE_SPIN	1000
+
+static inline int ssd1963_pipe_ready(struct ssd1963_pipe *p)
+{
+	unsigned i;
+
+	for (i = 0; i < SSD1963_PIPE_SPIN; i++) {
+		if (ACCESS_ONCE(p->head) != p->tail)
+			return 1;
+		cpu_relax();
+	}
+	return 0;
+}
+
+/* SSD_SET_COLUMN_ADDRESS(), SSD_SET_PAGE_ADDRESS() and
+ * SSD_WRITE_MEMORY_START() on a single panel's bus */
+static void ssd1963_bus_window(const struct ssd_bus *bus, u32 x, u32 y, u32 w,
+			       u32 h)
+{
+	const u16 a[2][2] = { { x, x + w - 1 }, { y, y + h - 1 } };
+	unsigned i, j;
+
+	for (i = 0; i < 2; i++) {
+		ssd_bus_wr_slow_cmd(bus, 0x2a + i);
+		for (j = 0; j < 2; j++) {
+			ssd_bus_wr0(bus, ssd_bus_enc(bus, a[i][j] >> 8));
+			ssd_bus_wr0(bus, ssd_bus_enc(bus, a[i][j] & 0xff));
+		}
+	}
+	ssd_bus_wr_slow_cmd(bus, 0x2c);
+}
+
+static int ssd1963_pipe_emitter(void *data)
+{
+	struct ssd1963_pipe *p = data;
+	struct ssd1963_pipe_buf *b;
+
+	while (!kthread_should_stop()) {
+		if (!ssd1963_pipe_ready(p)) {
+			wait_event_interruptible(p->full_wq,
+				ACCESS_ONCE(p->head) != p->tail ||
+				kthread_should_stop());
+			continue;
+		}
+		smp_rmb(); /* head before the buffer's contents */
+		b = &p->bufs[p->tail % SSD1963_PIPE_BUFS];
+		if (b->w)
+			ssd1963_bus_window(p->bus, b->x, b->y, b->w, b->h);
+		ssd_bus_wr_words(p->bus, b->words, b->n);
+
+		/* the stores are issued before the buffer is handed back */
+		wmb();
+		ACCESS_ONCE(p->tail) = p->tail + 1;
+		smp_mb();
+		if (waitqueue_active(&p->free_wq))
+			wake_up(&p->free_wq);
+	}
+	return 0;
+}
+
+/* the buffer being filled, waiting for the emitter to free one */
+static struct ssd1963_pipe_buf * ssd1963_pipe_get(struct ssd1963_pipe *p)
+{
+	if (!p->cur) {
+		wait_event(p->free_wq,
+			p->head - ACCESS_ONCE(p->tail) < SSD1963_PIPE_BUFS);
+		smp_mb(); /* the emitter is done with it */
+		p->cur = &p->bufs[p->head % SSD1963_PIPE_BUFS];
+		p->cur->w = 0;
+		p->cur->n = 0;
+	}
+	return p->cur;
+}
+
+/* hands the buffer being filled to the emitter */
+static void ssd1963_pipe_push(struct ssd1963_pipe *p)
+{
+	if (!p->cur)
+		return;
+	p->cur = NULL;
+	smp_wmb(); /* the buffer's contents before head */
+	ACCESS_ONCE(p->head) = p->head + 1;
+	smp_mb();
+	if (waitqueue_active(&p->full_wq))
+		wake_up(&p->full_wq);
+}
+
+/* waits until the emitter sent everything */
+static void ssd1963_pipe_drain(struct ssd1963_pipe *p)
+{
+	ssd1963_pipe_push(p);
+	wait_event(p->free_wq, ACCESS_ONCE(p->tail) == p->head);
+	smp_mb();
+}
+
+/* appends n pixels of color c */
+static void ssd1963_pipe_px(struct ssd1963_pipe *p, u32 c, u32 n)
+{
+	struct ssd1963_pipe_buf *b;
+	u32 m;
+
+	while (n) {
+		b = ssd1963_pipe_get(p);
+		m = min(n, (SSD1963_PIPE_WORDS - b->n) / SSD1963_PX_MAX_WORDS);
+		if (!m) {
+			ssd1963_pipe_push(p);
+			continue;
+		}
+		b->n = ssd1963_px_rep_enc(b->words + b->n, c, m) - b->words;
+		n -= m;
+	}
+}
+
+/* like __ssd1963_send_rect(), but encodes the rect into the pipe of the
+ * panel containing it, for that panel's bus */
+static __always_inline void __ssd1963_pipe_rect(struct ssd1963_fb *fb,
+						struct ssd1963_pipe *p, u32 x,
+						u32 y, u32 w, u32 h,
+						const u32 Bpp)
+{
+	struct ssd1963_pipe_buf *b;
+	u32 ll = fb->info.fix.line_length, sc = fb->scale;
+	u32 mask = fb->px_mask, c = 0, n = 0, px, i, r;
+	const u8 *s;
+
+	/* a window starts a buffer */
+	ssd1963_pipe_push(p);
+	b = ssd1963_pipe_get(p);
+	b->x = (x - p->x0) * sc;
+	b->y = (y - p->y0) * sc;
+	b->w = w * sc;
+	b->h = h * sc;
+
+	ssd1963_enc_bus = p->bus;
+	wr.color1_valid = 0;
+	for (; h; h--, y++) {
+		for (r = 0; r < sc; r++) {
+			s = fb->prev + y * ll + x * Bpp;
+			for (i = 0; i < w; i++, s += Bpp) {
+				px = ssd1963_shadow_px(s, Bpp) & mask;
+				if (n && px == c) {
+					n += sc;
+					continue;
+				}
+				ssd1963_pipe_px(p,
+					ssd1963_rect_color(fb, c, Bpp), n);
+				c = px;
+				n = sc;
+			}
+		}
+	}
+	ssd1963_pipe_px(p, ssd1963_rect_color(fb, c, Bpp), n);
+
+	b = ssd1963_pipe_get(p);
+	if (b->n == SSD1963_PIPE_WORDS) {
+		ssd1963_pipe_push(p);
+		b = ssd1963_pipe_get(p);
+	}
+	b->n += ssd1963_px_enc_flush(b->words + b->n);
+	ssd1963_enc_bus = &ssd1963_bus;
+}
+
+static void ssd1963_pipe_rect(struct ssd1963_fb *fb, struct ssd1963_pipe *p,
+			      u32 x, u32 y, u32 w, u32 h)
+{
+	switch (fb->info.var.bits_per_pixel / 8) {
+	case 1: __ssd1963_pipe_rect(fb, p, x, y, w, h, 1); break;
+	case 2: __ssd1963_pipe_rect(fb, p, x, y, w, h, 2); break;
+	case 3: __ssd1963_pipe_rect(fb, p, x, y, w, h, 3); break;
+	default: __ssd1963_pipe_rect(fb, p, x, y, w, h, 4); break;
+	}
+}
+
+/* Starts the emitter of pipe, bound to cpu if >= 0. */
+static int ssd1963_pipe_init(struct ssd1963_fb *fb, struct ssd1963_pipe *p,
+			     int cpu)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO / 2 };
+	unsigned n = p - fb->pipes;
+	struct task_struct *t;
+
+	p->bufs = vmalloc(SSD1963_PIPE_BUFS * sizeof(*p->bufs));
+	if (!p->bufs)
+		return -ENOMEM;
+	p->head = p->tail = 0;
+	p->cur = NULL;
+	init_waitqueue_head(&p->full_wq);
+	init_waitqueue_head(&p->free_wq);
+
+	t = kthread_create(ssd1963_pipe_emitter, p, DRIVER_NAME "/emit%u", n);
+	if (IS_ERR(t)) {
+		vfree(p->bufs);
+		p->bufs = NULL;
+		return PTR_ERR(t);
+	}
+	if (cpu >= 0)
+		kthread_bind(t, cpu);
+	if (pipe_fifo && sched_setscheduler(t, SCHED_FIFO, &param))
+		dev_warn(&fb->dev->dev, "cannot make the emitter SCHED_FIFO\n");
+	wake_up_process(t);
+	p->emitter = t;
+	print_debug("emitter %u on CPU %d\n", n, cpu);
+	return 0;
+}
+
+static void ssd1963_pipe_stop(struct ssd1963_fb *fb);
+
+/* A single panel's emitter is started if there is a CPU for it, otherwise the
+ * flush sends rects itself. Spanned panels need an emitter each; they are
+ * bound to the CPUs from pipe_cpu down as long as one is left for the worker,
+ * the others float. Before the worker is started. */
+static int ssd1963_pipe_start(struct ssd1963_fb *fb)
+{
+	int cpu = pipe_cpu, ncpus = num_online_cpus(), c, ret;
+	unsigned n;
+
+	if (fb->ntiles == 1 && (!pipeline || ncpus < 2))
+		return 0;
+	if (cpu < 0)
+		for_each_online_cpu(c)
+			cpu = c;
+	if (!cpu_online(cpu)) {
+		dev_warn(&fb->dev->dev, "pipe_cpu %d is offline\n", cpu);
+		if (fb->ntiles == 1)
+			return 0;
+		cpu = -1;
+	}
+
+	for (n = 0; n < fb->ntiles; n++) {
+		c = cpu - (int)n;
+		if (c < 0 || n + 1 >= ncpus || !cpu_online(c))
+			c = -1;
+		ret = ssd1963_pipe_init(fb, &fb->pipes[n], c);
+		if (ret && fb->ntiles > 1) {
+			dev_err(&fb->dev->dev, "cannot start emitter %u: %d\n",
+				n, ret);
+			ssd1963_pipe_stop(fb);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+/* after the worker stopped, the rings are empty */
+static void ssd1963_pipe_stop(struct ssd1963_fb *fb)
+{
+	struct ssd1963_pipe *p;
+
+	for (p = fb->pipes; p < fb->pipes + SSD1963_MAX_TILES; p++) {
+		if (!p->emitter)
+			continue;
+		kthread_stop(p->emitter);
+		p->emitter = NULL;
+		vfree(p->bufs);
+		p->bufs = NULL;
+	}
+}
+
+/* Compares n words of a line with the last transferred version and returns
+ * the spans of pixels [x0,x1) containing changes. Spans closer than gap
+ * pixels are merged. */
+static unsigned ssd1963_diff_line(const u32 *a, const u32 *b, u32 n, u32 Bpp,
+				  u32 xres, u32 gap, struct ssd1963_span *sp)
+{
+	unsigned ns = 0;
+	u32 i = 0, s, x0, x1;
+
+	while (i < n) {
+		/* equal parts are skipped 2 words at a time */
+		while (i + 2 <= n && !((a[i] ^ b[i]) | (a[i+1] ^ b[i+1])))
+			i += 2;
+		while (i < n && a[i] == b[i])
+			i++;
+		if (i == n)
+			break;
+		for (s = i; i < n && a[i] != b[i]; i++);
+
+		x0 = s * 4 / Bpp;
+		x1 = min(DIV_ROUND_UP(i * 4, Bpp), xres);
+		if (x0 >= x1) /* padding at the end of the line */
+			continue;
+		if (ns && (x0 <= sp[ns-1].x1 + gap || ns == SSD1963_MAX_SPANS)) {
+			sp[ns-1].x1 = x1;
+		} else {
+			sp[ns].x0 = x0;
+			sp[ns].x1 = x1;
+			ns++;
+		}
+	}
+	return ns;
+}
+
+/* Racing the beam: a flush too large to be sent within the vertical blanking
+ * tears wherever the panel's refresh overtakes the transfer. Instead it is
+ * started right behind the scan position at its first row and sent in scan
+ * order, split so it never gets ahead of the refresh. The frame being
+ * refreshed then shows the old content and the next one the new, as long as
+ * the transfer takes less than about two refreshes (e.g. 800x480 on the 8 bit
+ * bus). The scan position is read once per flush and predicted from the line
+ * period after. Only done unrotated and without vertically reversed address
+ * modes, where the rows are scanned in the order of the lines. */
+static bool race_beam = 1;
+module_param(race_beam, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(race_beam, "send large updates in the panel's scan order, "
+	"behind its refresh; needs rd_pin (default: 1)");
+
+#define SSD1963_RACE_CHUNK	8 /* rows waited for at once */
+
+/* the panel row showing line y, >= vsa if none */
+static inline u32 ssd1963_race_row(const struct ssd1963_fb *fb, u32 y)
+{
+	u32 vsa = fb->pdata->lcd.vert.visible;
+
+	if (y >= vsa)
+		return vsa;
+	return (y + vsa - fb->race_vsp) % vsa;
+}
+
+/* how many lines the beam is past row r in the raced frame, <= 0 if not */
+static s32 ssd1963_race_ahead(const struct ssd1963_fb *fb, u32 r)
+{
+	s64 dt = ktime_to_ns(ktime_sub(ktime_get(), fb->race_t0));
+
+	return fb->race_c0 + (s32)div_u64(dt, fb->line_ns) -
+	       (s32)(fb->iv.vps + r);
+}
+
+/* sleeps until the beam has passed row r, returns the ns slept */
+static u64 ssd1963_race_wait(const struct ssd1963_fb *fb, u32 r)
+{
+	s32 d = 1 - ssd1963_race_ahead(fb, r);
+	ktime_t t;
+	u32 us;
+
+	if (d <= 0)
+		return 0;
+	t = ktime_get();
+	us = d * fb->line_ns / 1000 + 1;
+	usleep_range(us, us + fb->line_ns / 1000);
+	return ktime_to_ns(ktime_sub(ktime_get(), t));
+}
+
+/* Decides whether the flush of lines races the beam and if so reads the
+ * scanline. Returns the line to start the flush at. */
+static u32 ssd1963_race_start(struct ssd1963_fb *fb, const unsigned long *lines,
+			      u32 yres)
+{
+	const struct fb_var_screeninfo *var = &fb->info.var;
+	const struct ssd_init_vector *iv = &fb->iv;
+	u32 n, est, head, r0 = ~0U, y;
+	int c;
+
+	fb->racing = 0;
+	if (!race_beam || !fb->line_ns || !fb->px_ns16 || fb->scale > 1 ||
+	    fb->ntiles > 1 ||
+	    var->rotate != FB_ROTATE_UR ||
+	    fb->pdata->lcd_addr_mode & (SSD_ADDR_HOST_VERT_REVERSE |
+					SSD_ADDR_PANEL_LINE_REVERSE))
+		return 0;
+
+	/* estimated transfer time in lines, if it fits into the vertical
+	 * blanking there is nothing to race */
+	n = bitmap_weight(lines, yres);
+	est = div_u64(((u64)n * var->xres_virtual * fb->px_ns16) >> 4,
+		      fb->line_ns);
+	if (est <= iv->vt - iv->vdp)
+		return 0;
+
+	fb->race_vsp = ssd1963_scroll_start(var, var->yoffset);
+	for_each_set_bit(y, lines, yres)
+		r0 = min(r0, ssd1963_race_row(fb, y));
+	if (r0 >= var->yres)
+		return 0;
+
+	c = ssd_get_scanline();
+	if (c < 0)
+		return 0;
+	fb->race_t0 = ktime_get();
+	fb->race_c0 = c;
+	fb->racing = 1;
+
+	/* Far past the first row already, the next refresh would overtake
+	 * the transfer where waiting for the beam to come around wouldn't. */
+	head = c > iv->vps + r0 ? c - (iv->vps + r0) : 0;
+	if (est < iv->vt + n && est + head >= iv->vt + n)
+		fb->race_c0 -= iv->vt;
+
+	return fb->race_vsp < yres ? fb->race_vsp : 0;
+}
+
+/* Spanned panels get the part of a rect they show, each into its own pipe,
+ * so their buses are driven concurrently by the emitters. */
+static inline void ssd1963_flush_send(struct ssd1963_fb *fb, u32 x, u32 y,
+				      u32 w, u32 h)
+{
+	struct ssd1963_pipe *p;
+	u32 x0, y0, x1, y1;
+
+	if (fb->ntiles == 1) {
+		if (fb->pipes[0].emitter)
+			ssd1963_pipe_rect(fb, &fb->pipes[0], x, y, w, h);
+		else
+			ssd1963_send_rect(fb, x, y, w, h);
+		return;
+	}
+	for (p = fb->pipes; p < fb->pipes + fb->ntiles; p++) {
+		x0 = max(x, p->x0);
+		y0 = max(y, p->y0);
+		x1 = min(x + w, p->x0 + fb->tile_w);
+		y1 = min(y + h, p->y0 + fb->tile_h);
+		if (x0 < x1 && y0 < y1)
+			ssd1963_pipe_rect(fb, p, x0, y0, x1 - x0, y1 - y0);
+	}
+}
+
+/* Sends a rect of the flush. When racing, only the rows the beam has passed
+ * are sent, waiting for it otherwise. */
+static void ssd1963_flush_rect(struct ssd1963_fb *fb, u32 x, u32 y, u32 w,
+			       u32 h)
+{
+	u32 r;
+	s32 n;
+
+	fb->flush_px += w * h * fb->scale * fb->scale;
+	while (fb->racing && h) {
+		r = ssd1963_race_row(fb, y);
+		if (r >= fb->info.var.yres)
+			break;
+		n = ssd1963_race_ahead(fb, r);
+		if (n <= 0) {
+			fb->race_slept += ssd1963_race_wait(fb,
+				r + min_t(u32, h, SSD1963_RACE_CHUNK) - 1);
+			continue;
+		}
+		n = min_t(u32, n, h);
+		ssd1963_flush_send(fb, x, y, w, n);
+		y += n;
+		h -= n;
+	}
+	if (h)
+		ssd1963_flush_send(fb, x, y, w, h);
+}
+
+/* Transfers the changes in the given lines of the shadow. Each line is
+ * snapshotted first, so that concurrent writers at worst cause another
+ * (correct) transfer later. Lines with a single span of the same columns as
+ * the previous line are merged into one window.
+ *
+ * A flush is done in chunks of SSD1963_FLUSH_CHUNK lines, the worker serves
+ * the ops queued meanwhile in between. Lines are cleared from lines as they
+ * are sent; returns 1 when none are left. */
+static int ssd1963_flush(struct ssd1963_fb *fb, unsigned long *lines,
+			 int first)
+{
+	struct ssd1963_span sp[SSD1963_MAX_SPANS];
+	u32 ll = fb->info.fix.line_length;
+	u32 Bpp = fb->info.var.bits_per_pixel / 8;
+	u32 xres = fb->info.var.xres_virtual;
+	u32 yres = min(fb->info.var.yres_virtual, (u32)SSD1963_MAX_LINES);
+	u32 gap = SSD1963_WINDOW_COST * 2 / ssd1963_px_words2();
+	u32 y, h, y0 = 0, h0 = 0, k, start, n = 0;
+	struct ssd1963_span sp0 = { 0, 0 };
+	unsigned ns, i;
+	unsigned long flags;
+	ktime_t t = ktime_get();
+	u64 dt;
+
+	fb->flush_px = 0;
+	fb->race_slept = 0;
+	if (first)
+		fb->flush_start = ssd1963_race_start(fb, lines, yres);
+	start = fb->flush_start;
+
+	/* in scan order from start on */
+	for (k = 0; k < yres; k++) {
+		y = k < yres - start ? start + k : k - (yres - start);
+		if (!test_bit(y, lines))
+			continue;
+		if (n++ == SSD1963_FLUSH_CHUNK)
+			break;
+		clear_bit(y, lines);
+		memcpy(fb->linebuf, fb->shadow + y * ll, ll);
+		h = jhash(fb->linebuf, ll, 0);
+		if (test_bit(y, fb->line_known) &&
+		    test_bit(y, fb->line_hashed) && fb->line_hash[y] == h)
+			continue;
+
+		if (!test_bit(y, fb->line_known)) {
+			sp[0].x0 = 0;
+			sp[0].x1 = xres;
+			ns = 1;
+		} else {
+			ns = ssd1963_diff_line((u32 *)fb->linebuf,
+					       (u32 *)(fb->prev + y * ll),
+					       ll / 4, Bpp, xres, gap, sp);
+		}
+
+		spin_lock_irqsave(&fb->op_lock, flags);
+		memcpy(fb->prev + y * ll, fb->linebuf, ll);
+		fb->line_hash[y] = h;
+		set_bit(y, fb->line_hashed);
+		set_bit(y, fb->line_known);
+		spin_unlock_irqrestore(&fb->op_lock, flags);
+
+		if (ns == 1 && h0 && y == y0 + h0 &&
+		    sp[0].x0 == sp0.x0 && sp[0].x1 == sp0.x1) {
+			h0++;
+			continue;
+		}
+		if (h0)
+			ssd1963_flush_rect(fb, sp0.x0, y0, sp0.x1 - sp0.x0, h0);
+		h0 = 0;
+		if (ns == 1) {
+			sp0 = sp[0];
+			y0 = y;
+			h0 = 1;
+			continue;
+		}
+		for (i = 0; i < ns; i++)
+			ssd1963_flush_rect(fb, sp[i].x0, y, sp[i].x1 - sp[i].x0,
+					   1);
+	}
+	if (h0)
+		ssd1963_flush_rect(fb, sp0.x0, y0, sp0.x1 - sp0.x0, h0);
+	for (i = 0; i < fb->ntiles; i++)
+		if (fb->pipes[i].emitter)
+			ssd1963_pipe_drain(&fb->pipes[i]);
+
+	/* the bus time per pixel for the next flush's estimate, from chunks
+	 * large enough not to be dominated by the diffing */
+	if (fb->flush_px >= xres) {
+		dt = ktime_to_ns(ktime_sub(ktime_get(), t)) - fb->race_slept;
+		dt = div_u64(dt << 4, fb->flush_px);
+		fb->px_ns16 = fb->px_ns16 ? (fb->px_ns16 * 7 + (u32)dt) / 8
+		                          : dt;
+	}
+
+	if (k < yres)
+		return 0;
+	/* lines past yres, e.g. from ssd1963_shadow_invalidate() */
+	bitmap_zero(lines, SSD1963_MAX_LINES);
+	return 1;
+}
+
+/* Interlaced flushes, off unless interlace is set: a flush of more than
+ * interlace_lines lines, or one asked for by SSD1963_DAMAGE_F_INTERLACE, only
+ * sends the lines y of one field, y % interlace, and leaves the others dirty
+ * for the flushes after it. Motion then shows at up to interlace times the
+ * rate full flushes allow, at a cost: a picture takes interlace flushes to
+ * complete, showing partial updates meanwhile, and every field sets up its
+ * windows again. More than 2 fields are sent coarse to fine, in bit reversed
+ * order (0, 4, 2, 6, 1, ... of 8). */
+static unsigned interlace;
+module_param(interlace, uint, S_IRUGO);
+MODULE_PARM_DESC(interlace, "fields of interlaced flushes, 0 (off), 2, 4 or "
+	"8; a picture then takes that many partial flushes, each with window "
+	"setup of its own (default: 0)");
+
+static unsigned interlace_lines;
+module_param(interlace_lines, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(interlace_lines, "with interlace set, interlace flushes of "
+	"more than this many lines, 0 only on request; e.g. 2 fields send a "
+	"picture as two half updates (default: 0)");
+
+static u32 ssd1963_field_phase(u32 i, u32 fields)
+{
+	u32 p = 0, b;
+
+	for (b = 1; b < fields; b <<= 1, i >>= 1)
+		p = p << 1 | (i & 1);
+	return p;
+}
+
+/* Called with op_lock held as a flush starts, fb->flushing just taken from
+ * fb->dirty. Moves the lines of all but the next field back and sets the
+ * fence the flush completes: with lines left for later, the one of
+ * interlace - 1 flushes before, when every field has been sent since. The
+ * next field is the next one in order having lines, so none is skipped. */
+static void ssd1963_flush_fields(struct ssd1963_fb *fb)
+{
+	u32 n = min(fb->info.var.yres_virtual, (u32)SSD1963_MAX_LINES);
+	u32 fields = interlace, present = 0, phase = 0, i, y;
+	int req = fb->interlace_req;
+
+	fb->interlace_req = 0;
+	switch (fields) {
+	case 2: case 4: case 8:
+		break;
+	default:
+		goto full;
+	}
+	if (!req && (!interlace_lines ||
+		     bitmap_weight(fb->flushing, n) <= interlace_lines))
+		goto full;
+
+	for_each_set_bit(y, fb->flushing, n)
+		present |= 1 << (y & (fields - 1));
+	for (i = 0; present && i < fields; i++) {
+		phase = ssd1963_field_phase(fb->field + i, fields);
+		if (present & 1 << phase)
+			break;
+	}
+	if (!present || present == 1 << phase)
+		goto full;
+	fb->field += i + 1;
+
+	for_each_set_bit(y, fb->flushing, n)
+		if ((y & (fields - 1)) != phase) {
+			clear_bit(y, fb->flushing);
+			set_bit(y, fb->dirty);
+		}
+	fb->seq_flushing = fb->seq_defer[0];
+	for (i = 0; i < fields - 2; i++)
+		fb->seq_defer[i] = fb->seq_defer[i + 1];
+	fb->seq_defer[fields - 2] = fb->seq_next;
+	return;
+full:
+	fb->seq_flushing = fb->seq_next;
+	for (i = 0; i < SSD1963_FIELDS_MAX - 1; i++)
+		fb->seq_defer[i] = fb->seq_next;
+}
+
+/* Makes the rect of the shadow the last transferred frame. Called by the fb
+ * ops after drawing into the shadow; the op they queue then sends it. */
+static void ssd1963_shadow_commit(struct ssd1963_fb *fb, u32 x, u32 y, u32 w,
+				  u32 h)
+{
+	u32 ll = fb->info.fix.line_length;
+	u32 Bpp = fb->info.var.bits_per_pixel / 8;
+	u32 off = y * ll + x * Bpp;
+	unsigned long flags;
+
+	spin_lock_irqsave(&fb->op_lock, flags);
+	for (; h; h--, y++, off += ll) {
+		memcpy(fb->prev + off, fb->shadow + off, w * Bpp);
+		if (y < SSD1963_MAX_LINES)
+			clear_bit(y, fb->line_hashed);
+	}
+	spin_unlock_irqrestore(&fb->op_lock, flags);
+}
+
+/* Sends what an fb op drew into the rect of op in the shadow: by queueing op
+ * or, while fb->diff_only or if it is larger than a flush chunk, by leaving it
+ * to the flush, which only transfers actual changes. */
+static void ssd1963_shadow_submit(struct ssd1963_fb *fb,
+				  const struct ssd1963_op *op)
+{
+	struct ssd1963_op o;
+
+	/* only fills and the senders of the shadow scale */
+	if (fb->scale > 1 && op->type != SSD1963_OP_FILL &&
+	    op->type != SSD1963_OP_COPY) {
+		ssd1963_op_free(op->data);
+		o = *op;
+		o.type = SSD1963_OP_COPY;
+		o.data = NULL;
+		op = &o;
+	}
+
+	/* too large to be sent without delaying the ops behind it; ops would
+	 * draw onto all spanned panels at once */
+	if (fb->diff_only || fb->ntiles > 1 ||
+	    op->w * op->h > SSD1963_FLUSH_CHUNK * fb->info.var.xres_virtual) {
+		ssd1963_op_free(op->data);
+		ssd1963_damage(fb, op->y, op->h, 0);
+		return;
+	}
+	ssd1963_shadow_commit(fb, op->x, op->y, op->w, op->h);
+	ssd1963_queue_op(fb, op);
+}
+
+/* Called after the initial set_par with the shadow still zeroed, i.e. black.
+ * Instead of letting the flush resend every line, GRAM is cleared by a single
+ * fill op, which only strobes #WR, or left as is for a splash to be drawn. */
+static void ssd1963_shadow_init_clear(struct ssd1963_fb *fb, int clear)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&fb->op_lock, flags);
+	bitmap_zero(fb->dirty, SSD1963_MAX_LINES);
+	if (clear)
+		bitmap_fill(fb->line_known, SSD1963_MAX_LINES);
+	spin_unlock_irqrestore(&fb->op_lock, flags);
+
+	/* spanned panels are cleared at once, each as large as a tile */
+	if (clear)
+		ssd1963_queue_op(fb, &(struct ssd1963_op){
+			.type = SSD1963_OP_FILL,
+			.w = fb->ntiles > 1 ? fb->tile_w
+			                    : fb->info.var.xres_virtual,
+			.h = fb->ntiles > 1 ? fb->tile_h
+			                    : fb->info.var.yres_virtual,
+			.fg = 0,
+		});
+}
+
+/* All of GRAM has to be resent, e.g. after a mode change. prev and the line
+ * hashes may then be of another stride or format: no line is diffed against
+ * them before the flush resent it in full and stored it anew. */
+static void ssd1963_shadow_invalidate(struct ssd1963_fb *fb)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&fb->op_lock, flags);
+	bitmap_zero(fb->line_hashed, SSD1963_MAX_LINES);
+	spin_unlock_irqrestore(&fb->op_lock, flags);
+	ssd1963_damage(fb, 0, SSD1963_MAX_LINES, 1);
+}
+
+/* converts 8 bit per channel RGB to the var (and therefore bus) format */
+static inline u32 ssd1963_px_pack(const struct fb_var_screeninfo *var, u32 r,
+				  u32 g, u32 b)
+{
+	return (r >> (8 - var->red.length)) << var->red.offset |
+	       (g >> (8 - var->green.length)) << var->green.offset |
+	       (b >> (8 - var->blue.length)) << var->blue.offset;
+}
+
+/* draws 16 (565), 24 (B, G, R) or 32 (xRGB) bit images into the shadow */
+static void ssd1963_shadow_image(struct fb_info *p, const struct fb_image *image)
+{
+	const struct fb_var_screeninfo *var = &p->var;
+	u32 Bpp = var->bits_per_pixel / 8, sBpp = image->depth / 8;
+	const u8 *s = image->data;
+	u32 x, y, v, px;
+	u8 *d;
+
+	for (y = 0; y < image->height; y++) {
+		d = p->screen_base + (image->dy + y) * p->fix.line_length +
+		    image->dx * Bpp;
+		for (x = 0; x < image->width; x++, s += sBpp, d += Bpp) {
+			switch (sBpp) {
+			case 2:
+				v = *(const u16 *)s;
+				px = ssd1963_px_pack(var,
+					(v >> 8 & 0xf8) | v >> 13,
+					(v >> 3 & 0xfc) | (v >> 9 & 0x03),
+					(v << 3 & 0xf8) | (v >> 2 & 0x07));
+				break;
+			case 3:
+				px = ssd1963_px_pack(var, s[2], s[1], s[0]);
+				break;
+			default:
+				v = *(const u32 *)s;
+				px = ssd1963_px_pack(var, v >> 16 & 0xff,
+						     v >> 8 & 0xff, v & 0xff);
+				break;
+			}
+			ssd1963_shadow_put(d, Bpp, px);
+		}
+	}
+}
+
+static void ssd1963_fb_deferred_io(struct fb_info *info,
+				   struct list_head *pagelist)
+{
+	struct ssd1963_fb *fb = container_of(info, struct ssd1963_fb, info);
+	u32 ll = info->fix.line_length;
+	unsigned long off;
+	struct page *page;
+	u32 y0, y1;
+
+	list_for_each_entry(page, pagelist, lru) {
+		off = page->index << PAGE_SHIFT;
+		y0 = off / ll;
+		y1 = min((u32)((off + PAGE_SIZE + ll - 1) / ll),
+			 info->var.yres_virtual);
+		if (y0 < y1)
+			ssd1963_damage(fb, y0, y1 - y0, 0);
+	}
+}
+
+static void ssd1963_exec_copy(const struct ssd1963_op *op)
+{
+	ssd1963_send_rect(&this_fb, op->x, op->y, op->w, op->h);
+}
+
+static inline int ssd1963_seq_after(u32 a, u32 b)
+{
+	return (s32)(a - b) > 0;
+}
+
+/* A fence is queued behind the ops of a command buffer. The lines it left to
+ * the flush are either still dirty, then the next flush sends them, or being
+ * flushed already. */
+static void ssd1963_exec_fence(const struct ssd1963_op *op)
+{
+	struct ssd1963_fb *fb = &this_fb;
+	unsigned long flags;
+
+	spin_lock_irqsave(&fb->op_lock, flags);
+	if (!bitmap_empty(fb->dirty, SSD1963_MAX_LINES))
+		fb->seq_next = op->fg;
+	else if (fb->flush_busy)
+		fb->seq_flushing = op->fg;
+	else
+		fb->seq_done = op->fg;
+	spin_unlock_irqrestore(&fb->op_lock, flags);
+}
+
+/* No TE line is wired, the vertical blanking is found by reading the
+ * scanline. Does nothing without rd_pin. */
+static void ssd1963_exec_vblank(const struct ssd1963_op *op)
+{
+	struct ssd1963_fb *fb = &this_fb;
+	const struct ssd_init_vector *iv = &fb->iv;
+	int c;
+	u32 us;
+
+	if (!fb->line_ns)
+		return;
+	c = ssd_get_scanline();
+	if (c < iv->vps || c >= iv->vps + iv->vdp)
+		return;
+	us = (iv->vps + iv->vdp - c) * fb->line_ns / 1000 + 1;
+	usleep_range(us, us + fb->line_ns / 1000);
+}
+
+static void ssd1963_exec_op(const struct ssd1963_op *op)
+{
+	switch (op->type) {
+	case SSD1963_OP_FILL:
+		ssd1963_exec_fill(op);
+		break;
+	case SSD1963_OP_BLIT:
+		ssd1963_exec_blit(op);
+		break;
+	case SSD1963_OP_WINDOW:
+		ssd1963_exec_window(op);
+		break;
+	case SSD1963_OP_COPY:
+		ssd1963_exec_copy(op);
+		break;
+	case SSD1963_OP_SCROLL:
+		SSD_SET_SCROLL_START(op->y);
+		break;
+	case SSD1963_OP_FENCE:
+		ssd1963_exec_fence(op);
+		break;
+	case SSD1963_OP_VBLANK:
+		ssd1963_exec_vblank(op);
+		break;
+	}
+}
+
+/* nothing to send, or nothing that can be sent while suspended */
+static inline int ssd1963_fb_idle(struct ssd1963_fb *fb)
+{
+	return fb->pm_state != SSD1963_PM_ON ||
+	       (!ssd1963_op_pending(fb) && !fb->flush_busy &&
+	        bitmap_empty(fb->dirty, SSD1963_MAX_LINES));
+}
+
+/* Queued ops are the high priority queue and executed first, dirty lines are
+ * the low priority one and flushed chunk by chunk while there are no ops.
+ * The bus is released and the CPU yielded after each op or chunk. The power
+ * state is checked under bus_lock, so nothing is sent after suspend put the
+ * controller to sleep. */
+static int ssd1963_fb_worker(void *data)
+{
+	struct ssd1963_fb *fb = data;
+	struct ssd1963_op op;
+	unsigned long flags;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(fb->op_wq,
+			!ssd1963_fb_idle(fb) || kthread_should_stop());
+
+		mutex_lock(&fb->bus_lock);
+		spin_lock_irqsave(&fb->op_lock, flags);
+		if (ssd1963_fb_idle(fb)) {
+			spin_unlock_irqrestore(&fb->op_lock, flags);
+			mutex_unlock(&fb->bus_lock);
+			continue;
+		}
+		if (!ssd1963_op_pending(fb)) {
+			int first = !fb->flush_busy, done;
+
+			if (first) {
+				bitmap_copy(fb->flushing, fb->dirty,
+					    SSD1963_MAX_LINES);
+				bitmap_zero(fb->dirty, SSD1963_MAX_LINES);
+				fb->flush_busy = 1;
+				ssd1963_flush_fields(fb);
+			}
+			spin_unlock_irqrestore(&fb->op_lock, flags);
+
+			done = ssd1963_flush(fb, fb->flushing, first);
+			mutex_unlock(&fb->bus_lock);
+
+			if (done) {
+				spin_lock_irqsave(&fb->op_lock, flags);
+				fb->flush_busy = 0;
+				if (ssd1963_seq_after(fb->seq_flushing,
+						      fb->seq_done))
+					fb->seq_done = fb->seq_flushing;
+				spin_unlock_irqrestore(&fb->op_lock, flags);
+				wake_up_all(&fb->done_wq);
+			}
+			cond_resched();
+			continue;
+		}
+		op = fb->ops[fb->op_tail % SSD1963_OP_RING];
+		spin_unlock_irqrestore(&fb->op_lock, flags);
+
+		ssd1963_exec_op(&op);
+		mutex_unlock(&fb->bus_lock);
+		ssd1963_op_free(op.data);
+
+		/* only now the slot is free and the op visibly completed */
+		spin_lock_irqsave(&fb->op_lock, flags);
+		fb->op_tail++;
+		spin_unlock_irqrestore(&fb->op_lock, flags);
+		wake_up_all(&fb->done_wq);
+		cond_resched();
+	}
+
+	return 0;
+}
+
+/* waits until all queued ops and damaged lines have been sent to the
+ * controller */
+static int ssd1963_fb_sync(struct fb_info *info)
+{
+	struct ssd1963_fb *fb = container_of(info, struct ssd1963_fb, info);
+
+	if (fb->worker)
+		wait_event(fb->done_wq, ssd1963_fb_idle(fb));
+	return 0;
+}
+
+/* --------------------------------------------------------------------------
+ * fb ops
+ * -------------------------------------------------------------------------- */
+
+static void ssd1963_fb_fillrect(struct fb_info *p, const struct fb_fillrect *rect)
+{
+	u32 c = rect->color;
+
+	if (p->state != FBINFO_STATE_RUNNING)
+		return;
+
+	if (p->fix.visual == FB_VISUAL_TRUECOLOR ||
+	    p->fix.visual == FB_VISUAL_DIRECTCOLOR)
+		c = ((u32 *)p->pseudo_palette)[c];
+/*
+	print_debug("rect %ux%u @ %u,%u w/ color %08x\n",
+		rect->width, rect->height, rect->dx, rect->dy, rect->color);
+*/
+	sys_fillrect(p, rect);
+	/* the result of ROP_XOR is only known to the shadow */
+	ssd1963_shadow_submit(&this_fb, &(struct ssd1963_op){
+		.type = rect->rop == ROP_COPY ? SSD1963_OP_FILL
+		                              : SSD1963_OP_COPY,
+		.x = rect->dx, .y = rect->dy,
+		.w = rect->width, .h = rect->height,
+		.fg = c,
+	});
+}
+
+static void ssd1963_fb_imageblit(struct fb_info *p, const struct fb_image *image)
+{
+	const u32 *palette = (u32 *)p->pseudo_palette;
+	struct ssd1963_op op = {
+		.type = SSD1963_OP_COPY,
+		.x = image->dx, .y = image->dy,
+		.w = image->width, .h = image->height,
+	};
+
+	if (p->state != FBINFO_STATE_RUNNING)
+		return;
+/*
+	print_debug("img %ux%u @ %u,%u w/ depth %d, color fg/bg %08x / %08x, cmap: %d %d\n",
+		image->width, image->height, image->dx, image->dy,
+		image->depth, fg, bg, image->cmap.start, image->cmap.len);
+*/
+	if (image->depth == 1 || image->depth == 8) {
+		/* the palette (fbcon temporarily swaps it for the logo) is
+		 * only valid during this call, so convert right away */
+		sys_imageblit(p, image);
+	} else if ((image->depth == 16 || image->depth == 24 ||
+		    image->depth == 32) && p->var.bits_per_pixel > 8) {
+		ssd1963_shadow_image(p, image);
+	} else {
+		printk(KERN_ERR MODULE_NAME " imageblit: unsupported depth "
+			"%d\n", image->depth);
+		return;
+	}
+
+	if (image->depth == 1) {
+		/* resent as a 1 bpp blit to make use of the glyph cache */
+		u32 len = (image->width + 7) / 8 * image->height;
+		op.type = SSD1963_OP_BLIT;
+		op.fg = image->fg_color;
+		op.bg = image->bg_color;
+		if (p->fix.visual == FB_VISUAL_TRUECOLOR ||
+		    p->fix.visual == FB_VISUAL_DIRECTCOLOR) {
+			op.fg = palette[op.fg];
+			op.bg = palette[op.bg];
+		}
+		op.data = ssd1963_op_alloc(len);
+		if (!op.data) {
+			/* leave it to the flush */
+			ssd1963_damage(&this_fb, image->dy, image->height, 0);
+			return;
+		}
+		memcpy(op.data, image->data, len);
+	}
+	ssd1963_shadow_submit(&this_fb, &op);
+}
+
+/* The cursor is an overlay never drawn into the shadow: showing it sends the
+ * cell as 1 bpp blit of the glyph combined with the mask, hiding it resends
+ * the cell's shadow content. Both only cover the cursor's window. Returning
+ * an error makes fbcon fall back to its soft cursor. */
+static int ssd1963_fb_cursor(struct fb_info *info, struct fb_cursor *cursor)
+{
+	const struct fb_image *img = &cursor->image;
+	const u32 *palette = (u32 *)info->pseudo_palette;
+	u32 len = (img->width + 7) / 8 * img->height, i;
+	struct ssd1963_op op = {
+		.type = SSD1963_OP_COPY,
+		.x = img->dx, .y = img->dy,
+		.w = img->width, .h = img->height,
+	};
+	u8 *src;
+
+	if (info->state != FBINFO_STATE_RUNNING)
+		return 0;
+	/* soft cursor in scaled modes and on spanned panels */
+	if (this_fb.scale > 1 || this_fb.ntiles > 1)
+		return -EINVAL;
+	if (img->depth != 1 || !img->data || !cursor->mask ||
+	    !img->width || !img->height ||
+	    img->dx + img->width > info->var.xres_virtual ||
+	    img->dy + img->height > info->var.yres_virtual)
+		return -EINVAL;
+
+	if (cursor->enable) {
+		src = ssd1963_op_alloc(len);
+		if (!src)
+			return -ENOMEM;
+		for (i = 0; i < len; i++)
+			src[i] = cursor->rop == ROP_XOR
+			       ? img->data[i] ^ cursor->mask[i]
+			       : img->data[i] & cursor->mask[i];
+		op.type = SSD1963_OP_BLIT;
+		op.data = src;
+		op.fg = img->fg_color;
+		op.bg = img->bg_color;
+		if (info->fix.visual == FB_VISUAL_TRUECOLOR ||
+		    info->fix.visual == FB_VISUAL_DIRECTCOLOR) {
+			op.fg = palette[op.fg];
+			op.bg = palette[op.bg];
+		}
+	}
+	ssd1963_queue_op(&this_fb, &op);
+	return 0;
+}
+
+/*
+static struct {
+	unsigned sleep   : 1;
+	unsigned idle    : 1;
+	unsigned partial : 1;
+	unsigned display : 1;
+} ssd1963_mode;
+*/
+static int ssd1963_fb_blank(int blank, struct fb_info *info)
+{
+	int ret = 0;
+
+	print_debug("blank: %d\n", blank);
+	ssd1963_fb_sync(info);
+	mutex_lock(&this_fb.bus_lock);
+	/* the display may be off now, set_par has to turn it on again */
+	this_fb.par_sent_valid = 0;
+	switch (blank) {
+	case FB_BLANK_UNBLANK:
+		SSD_EXIT_SLEEP_MODE();
+		msleep(5);
+		break;
+	case FB_BLANK_NORMAL:
+		SSD_SET_DISPLAY_OFF();
+		break;
+	case FB_BLANK_POWERDOWN:
+		SSD_ENTER_SLEEP_MODE();
+		msleep(5);
+		break;
+	default:
+		ret = 1;
+	}
+	mutex_unlock(&this_fb.bus_lock);
+	return ret;
+}
+
+static inline u32 convert_bitfield(int val, struct fb_bitfield *bf)
+{
+	unsigned int mask = (1 << bf->length) - 1;
+	return (val >> (16 - bf->length) & mask) << bf->offset;
+}
+
+/* Up to 8 bpp the shadow holds palette indices, which the flush and the ops
+ * look up in lut. Its entries are kept as colors in the bus format, i.e.
+ * what the encoders take, so nothing but the lookup happens per pixel.
+ * Returns whether the entry changed. */
+static int ssd1963_lut_set(unsigned regno, unsigned red, unsigned green,
+			   unsigned blue)
+{
+	unsigned rl = 8, gl = 8, bl = 8;
+	u32 c;
+
+	switch (this_fb.pdata->bus_fmt) {
+	case SSD_DATA_16_565:
+		rl = 5; gl = 6; bl = 5;
+		break;
+	case SSD_DATA_9:
+	case SSD_DATA_18:
+		rl = gl = bl = 6;
+		break;
+	default:
+		break;
+	}
+	c = (red >> (16 - rl)) << (gl + bl) |
+	    (green >> (16 - gl)) << bl |
+	    blue >> (16 - bl);
+	if (this_fb.lut[regno] == c)
+		return 0;
+	this_fb.lut[regno] = c;
+	return 1;
+}
+
+static int ssd1963_fb_setcolreg(unsigned int regno, unsigned int red,
+				unsigned int green, unsigned int blue,
+				unsigned int transp, struct fb_info *info)
+{
+	print_debug("setcolreg %d:(%02x,%02x,%02x,%02x) %x\n",
+		regno, red, green, blue, transp, info->fix.visual);
+	if (regno > 255)
+		return 1;
+	if (info->var.bits_per_pixel <= 8) {
+		/* the shadow didn't change, what was sent did */
+		if (ssd1963_lut_set(regno, red, green, blue))
+			ssd1963_shadow_invalidate(&this_fb);
+	} else if (regno < 16) {
+		this_fb.cmap[regno] =
+			convert_bitfield(transp, &info->var.transp) |
+			convert_bitfield(blue, &info->var.blue)     |
+			convert_bitfield(green, &info->var.green)   |
+			convert_bitfield(red, &info->var.red);
+	}
+	return 0;
+}
+
+/* like fb_set_cmap()'s fallback, but resends the screen once */
+static int ssd1963_fb_setcmap(struct fb_cmap *cmap, struct fb_info *info)
+{
+	const u16 *red = cmap->red, *green = cmap->green, *blue = cmap->blue;
+	const u16 *transp = cmap->transp;
+	u32 i, regno;
+	int changed = 0;
+
+	for (i = 0; i < cmap->len; i++) {
+		regno = cmap->start + i;
+		if (regno > 255)
+			return -EINVAL;
+		if (info->var.bits_per_pixel <= 8)
+			changed |= ssd1963_lut_set(regno, red[i], green[i],
+						   blue[i]);
+		else
+			ssd1963_fb_setcolreg(regno, red[i], green[i], blue[i],
+					     transp ? transp[i] : 0xffff, info);
+	}
+	if (changed)
+		ssd1963_shadow_invalidate(&this_fb);
+	return 0;
+}
+
+static int ssd1963_fb_pan_display(struct fb_var_screeninfo *var,
+				  struct fb_info *info)
+{
+	// print_debug("yoff: %u\n", var->yoffset);
+	if (ssd1963_rotated_90(&info->var) || this_fb.tiles_y > 1)
+		return var->yoffset ? -EINVAL : 0;
+	/* must stay ordered with respect to the drawing ops, sent to all
+	 * panels at once */
+	ssd1963_queue_op(&this_fb, &(struct ssd1963_op){
+		.type = SSD1963_OP_SCROLL,
+		.y = ssd1963_scroll_start(&info->var, var->yoffset),
+	});
+	return 0;
+}
+
+static void ssd1963_fb_copyarea(struct fb_info *info,
+				const struct fb_copyarea *region)
+{
+	if (info->state != FBINFO_STATE_RUNNING)
+		return;
+
+	sys_copyarea(info, region);
+	ssd1963_shadow_submit(&this_fb, &(struct ssd1963_op){
+		.type = SSD1963_OP_COPY,
+		.x = region->dx, .y = region->dy,
+		.w = region->width, .h = region->height,
+	});
+}
+
+static ssize_t ssd1963_fb_write(struct fb_info *info, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	u32 ll = info->fix.line_length;
+	loff_t pos = *ppos;
+	ssize_t ret;
+
+	ret = fb_sys_write(info, buf, count, ppos);
+	if (ret > 0)
+		ssd1963_damage(&this_fb, (u32)pos / ll,
+			       ((u32)pos + ret - 1) / ll - (u32)pos / ll + 1, 0);
+	return ret;
+}
+
+/* angle as in fb_var_screeninfo.rotate */
+static void ssd1963_fb_rotate(struct fb_info *info, int angle)
+{
+	struct fb_var_screeninfo var = info->var;
+
+	if (angle < FB_ROTATE_UR || angle > FB_ROTATE_CCW ||
+	    (u32)angle == var.rotate)
+		return;
+	if (ssd1963_rotated_90(&var) != (angle & 1)) {
+		swap(var.xres, var.yres);
+		swap(var.xres_virtual, var.yres_virtual);
+	}
+	var.rotate = angle;
+	var.yoffset = 0;
+	var.activate = FB_ACTIVATE_NOW;
+	if (fb_set_var(info, &var))
+		pr_err(MODULE_NAME ": cannot rotate to %d\n", angle);
+}
+
+/* --------------------------------------------------------------------------
+ * command buffers
+ * -------------------------------------------------------------------------- */
+
+/* bytes of a line of the command's pixel data, 0 if it has none */
+static u32 ssd1963_cmd_row(const struct fb_var_screeninfo *var,
+			   const struct ssd1963_cmd *c)
+{
+	if (c->op == SSD1963_CMD_WRITE)
+		return c->w * (var->bits_per_pixel / 8);
+	if (c->op != SSD1963_CMD_BLIT)
+		return 0;
+	switch (c->fmt) {
+	case SSD1963_FMT_MONO:     return (c->w + 7) / 8;
+	case SSD1963_FMT_RGB565:   return c->w * 2;
+	case SSD1963_FMT_BGR888:   return c->w * 3;
+	case SSD1963_FMT_XRGB8888: return c->w * 4;
+	}
+	return 0;
+}
+
+/* Returns the bytes of inline data following the command, or -EINVAL. avail
+ * is what is left of the buffer behind the command. */
+static int ssd1963_cmd_check(const struct fb_var_screeninfo *var,
+			     const struct ssd1963_cmd *c, u32 avail)
+{
+	u32 row = ssd1963_cmd_row(var, c);
+	u64 len;
+
+	if (c->flags & ~SSD1963_CMD_F_REF ||
+	    ((c->flags & SSD1963_CMD_F_REF) && !row))
+		return -EINVAL;
+	if (!c->w || !c->h ||
+	    c->x + c->w > var->xres_virtual || c->y + c->h > var->yres_virtual)
+		return -EINVAL;
+
+	switch (c->op) {
+	case SSD1963_CMD_FILL:
+		break;
+	case SSD1963_CMD_COPY:
+		if (c->sx + c->w > var->xres_virtual ||
+		    c->sy + c->h > var->yres_virtual)
+			return -EINVAL;
+		break;
+	case SSD1963_CMD_BLIT:
+		/* the shadow can't convert colors to palette indices */
+		if (c->fmt != SSD1963_FMT_MONO && var->bits_per_pixel <= 8)
+			return -EINVAL;
+		/* fall through */
+	case SSD1963_CMD_WRITE:
+		if (!row || (c->pitch && c->pitch < row))
+			return -EINVAL;
+		len = ssd1963_cmd_data_len(row, c->pitch, c->h);
+		if (c->flags & SSD1963_CMD_F_REF) {
+			if (c->size || len > ULONG_MAX ||
+			    !access_ok(VERIFY_READ,
+					(const void __user *)(unsigned long)c->data,
+					len))
+				return -EINVAL;
+			return 0;
+		}
+		if (c->size < len)
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+	return ssd1963_cmd_inline_size(c->size, avail);
+}
+
+/* 0xRRGGBB to the shadow's format, palette indices pass */
+static u32 ssd1963_cmd_color(const struct fb_var_screeninfo *var, u32 c)
+{
+	if (var->bits_per_pixel <= 8)
+		return c & 0xff;
+	return ssd1963_px_pack(var, c >> 16 & 0xff, c >> 8 & 0xff, c & 0xff);
+}
+
+/* draws a fill or 1 bpp blit op into the shadow */
+static void ssd1963_shadow_op(struct fb_info *info, const struct ssd1963_op *op)
+{
+	u32 Bpp = info->var.bits_per_pixel / 8, bpl = (op->w + 7) / 8, x, y;
+	const u8 *bits = op->data;
+	u32 px;
+	u8 *d;
+
+	for (y = 0; y < op->h; y++, bits += bpl) {
+		d = info->screen_base + (op->y + y) * info->fix.line_length +
+		    op->x * Bpp;
+		for (x = 0; x < op->w; x++, d += Bpp) {
+			px = op->fg;
+			if (op->type == SSD1963_OP_BLIT &&
+			    !(bits[x / 8] & 0x80 >> x % 8))
+				px = op->bg;
+			ssd1963_shadow_put(d, Bpp, px);
+		}
+	}
+}
+
+/* Executes a checked command like the corresponding fb op: it is drawn into
+ * the shadow and submitted as op. Pixel data is copied into a packed buffer,
+ * which the op owns for 1 bpp blits. */
+static int ssd1963_cmd_exec(struct ssd1963_fb *fb, const struct ssd1963_cmd *c,
+			    const u8 *inl)
+{
+	static const u8 depth[] = {
+		[SSD1963_FMT_RGB565]   = 16,
+		[SSD1963_FMT_BGR888]   = 24,
+		[SSD1963_FMT_XRGB8888] = 32,
+	};
+	struct fb_info *info = &fb->info;
+	const struct fb_var_screeninfo *var = &info->var;
+	struct ssd1963_op op = {
+		.type = SSD1963_OP_COPY,
+		.x = c->x, .y = c->y,
+		.w = c->w, .h = c->h,
+	};
+	const void __user *ref = (const void __user *)(unsigned long)c->data;
+	u32 row = ssd1963_cmd_row(var, c), pitch = c->pitch ? c->pitch : row;
+	u32 ll = info->fix.line_length, y;
+	u8 *buf = NULL;
+
+	if (row) {
+		buf = ssd1963_op_alloc(row * c->h);
+		if (!buf)
+			return -ENOMEM;
+		for (y = 0; y < c->h; y++) {
+			if (!(c->flags & SSD1963_CMD_F_REF))
+				memcpy(buf + y * row, inl + y * pitch, row);
+			else if (copy_from_user(buf + y * row, ref + y * pitch,
+						row)) {
+				ssd1963_op_free(buf);
+				return -EFAULT;
+			}
+		}
+	}
+
+	switch (c->op) {
+	case SSD1963_CMD_FILL:
+		op.type = SSD1963_OP_FILL;
+		op.fg = ssd1963_cmd_color(var, c->fg);
+		ssd1963_shadow_op(info, &op);
+		break;
+	case SSD1963_CMD_COPY:
+		sys_copyarea(info, &(struct fb_copyarea){
+			.dx = c->x, .dy = c->y,
+			.width = c->w, .height = c->h,
+			.sx = c->sx, .sy = c->sy,
+		});
+		break;
+	case SSD1963_CMD_BLIT:
+		if (c->fmt == SSD1963_FMT_MONO) {
+			op.type = SSD1963_OP_BLIT;
+			op.fg = ssd1963_cmd_color(var, c->fg);
+			op.bg = ssd1963_cmd_color(var, c->bg);
+			op.data = buf;
+			ssd1963_shadow_op(info, &op);
+			break;
+		}
+		ssd1963_shadow_image(info, &(struct fb_image){
+			.dx = c->x, .dy = c->y,
+			.width = c->w, .height = c->h,
+			.depth = depth[c->fmt],
+			.data = (const char *)buf,
+		});
+		ssd1963_op_free(buf);
+		break;
+	case SSD1963_CMD_WRITE:
+		for (y = 0; y < c->h; y++)
+			memcpy(info->screen_base + (c->y + y) * ll +
+			       c->x * (var->bits_per_pixel / 8),
+			       buf + y * row, row);
+		ssd1963_op_free(buf);
+		break;
+	}
+	ssd1963_shadow_submit(fb, &op);
 	return 0;
 }
 
-static void ssd1963_fb_copyarea(struct fb_info *info,
-				const struct fb_copyarea *region)
+/* queues the fence of the ops submitted before, cmd_lock held */
+static u32 ssd1963_cmd_fence(struct ssd1963_fb *fb)
+{
+	ssd1963_queue_op(fb, &(struct ssd1963_op){
+		.type = SSD1963_OP_FENCE,
+		.fg = ++fb->seq_head,
+	});
+	return fb->seq_head;
+}
+
+/* Copies in and checks the whole buffer, executes it and queues a fence
+ * completing its sequence number. An error while executing (no memory, a
+ * faulting reference to pixel data) aborts the buffer after the commands
+ * before it; the sequence number is then still returned and completes. */
+static int ssd1963_cmd_submit(struct ssd1963_fb *fb,
+			      struct ssd1963_cmdbuf *cb)
+{
+	const struct fb_var_screeninfo *var = &fb->info.var;
+	const struct ssd1963_cmd *c;
+	u32 off, n;
+	u8 *buf;
+	int ret;
+
+	if (!cb->size || cb->size > SSD1963_CMDBUF_MAX)
+		return -EINVAL;
+	if (fb->info.state != FBINFO_STATE_RUNNING || !fb->worker)
+		return -EBUSY;
+
+	buf = vmalloc(cb->size);
+	if (!buf)
+		return -ENOMEM;
+	if (copy_from_user(buf, (const void __user *)(unsigned long)cb->cmds,
+			   cb->size)) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	for (off = 0; off < cb->size; off += sizeof(*c) + n) {
+		c = (const struct ssd1963_cmd *)(buf + off);
+		ret = -EINVAL;
+		if (cb->size - off < sizeof(*c))
+			goto out;
+		ret = ssd1963_cmd_check(var, c, cb->size - off - sizeof(*c));
+		if (ret < 0)
+			goto out;
+		n = ret;
+	}
+
+	mutex_lock(&fb->cmd_lock);
+	ret = 0;
+	for (off = 0; off < cb->size && !ret; off += sizeof(*c) + n) {
+		c = (const struct ssd1963_cmd *)(buf + off);
+		n = ALIGN(c->size, 8);
+		ret = ssd1963_cmd_exec(fb, c, (const u8 *)(c + 1));
+	}
+	cb->seq = ssd1963_cmd_fence(fb);
+	mutex_unlock(&fb->cmd_lock);
+out:
+	vfree(buf);
+	return ret;
+}
+
+/* The rects are committed and sent as copy ops, i.e. through the window
+ * write path, unless larger than a flush chunk or to be interlaced. */
+static int ssd1963_damage_submit(struct ssd1963_fb *fb,
+				 struct ssd1963_damage *d)
+{
+	const struct fb_var_screeninfo *var = &fb->info.var;
+	struct ssd1963_rect *r;
+	unsigned long flags;
+	u32 i;
+	int ret = 0;
+
+	if (!d->n || d->n > SSD1963_DAMAGE_MAX ||
+	    d->flags & ~(SSD1963_DAMAGE_F_VBLANK | SSD1963_DAMAGE_F_INTERLACE))
+		return -EINVAL;
+	if (fb->info.state != FBINFO_STATE_RUNNING || !fb->worker)
+		return -EBUSY;
+
+	r = kmalloc(d->n * sizeof(*r), GFP_KERNEL);
+	if (!r)
+		return -ENOMEM;
+	if (copy_from_user(r, (const void __user *)(unsigned long)d->rects,
+			   d->n * sizeof(*r))) {
+		ret = -EFAULT;
+		goto out;
+	}
+	for (i = 0; i < d->n; i++)
+		if (!r[i].w || !r[i].h ||
+		    r[i].x + r[i].w > var->xres_virtual ||
+		    r[i].y + r[i].h > var->yres_virtual) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+	mutex_lock(&fb->cmd_lock);
+	if (d->flags & SSD1963_DAMAGE_F_VBLANK)
+		ssd1963_queue_op(fb, &(struct ssd1963_op){
+			.type = SSD1963_OP_VBLANK,
+		});
+	if (d->flags & SSD1963_DAMAGE_F_INTERLACE) {
+		spin_lock_irqsave(&fb->op_lock, flags);
+		fb->interlace_req = 1;
+		spin_unlock_irqrestore(&fb->op_lock, flags);
+	}
+	for (i = 0; i < d->n; i++) {
+		if (d->flags & SSD1963_DAMAGE_F_INTERLACE) {
+			ssd1963_damage(fb, r[i].y, r[i].h, 0);
+			continue;
+		}
+		ssd1963_shadow_submit(fb, &(struct ssd1963_op){
+			.type = SSD1963_OP_COPY,
+			.x = r[i].x, .y = r[i].y,
+			.w = r[i].w, .h = r[i].h,
+		});
+	}
+	d->seq = ssd1963_cmd_fence(fb);
+	mutex_unlock(&fb->cmd_lock);
+out:
+	kfree(r);
+	return ret;
+}
+
+static inline int ssd1963_seq_sent(struct ssd1963_fb *fb, u32 seq)
 {
-	/* TODO: no implementation yet */
-	print_debug("%u,%u -> %u,%u, size: %ux%u\n",
-		region->sx, region->sy, region->dx, region->dy,
-		region->width, region->height);
+	return !ssd1963_seq_after(seq, ACCESS_ONCE(fb->seq_done));
 }
 
-static ssize_t ssd1963_fb_read(struct fb_info *info, char __user *buf,
-			       size_t count, loff_t *ppos)
+static int ssd1963_cmd_wait(struct ssd1963_fb *fb,
+			    const struct ssd1963_wait *w)
 {
-	print_debug("reading %zu bytes to user %p at %llu\n", count, buf, *ppos);
-	*ppos += count;
-	return count;
+	long ret;
+
+	if (ssd1963_seq_after(w->seq, ACCESS_ONCE(fb->seq_head)))
+		return -EINVAL;
+	if (ssd1963_seq_sent(fb, w->seq))
+		return 0;
+	if (!w->timeout_ms)
+		return -EAGAIN;
+	if (w->timeout_ms == SSD1963_WAIT_FOREVER)
+		return wait_event_interruptible(fb->done_wq,
+			ssd1963_seq_sent(fb, w->seq));
+	ret = wait_event_interruptible_timeout(fb->done_wq,
+		ssd1963_seq_sent(fb, w->seq), msecs_to_jiffies(w->timeout_ms));
+	if (ret < 0)
+		return ret;
+	return ret ? 0 : -ETIMEDOUT;
 }
 
-static ssize_t ssd1963_fb_write(struct fb_info *info, const char __user *buf,
-				size_t count, loff_t *ppos)
+/* Command buffers batch drawing into one call, see ssd1963_ioctl.h. Their
+ * structures are laid out the same for 32 and 64 bit userspace. */
+static int ssd1963_fb_ioctl(struct fb_info *info, unsigned int cmd,
+			    unsigned long arg)
 {
-	print_debug("writing %zu bytes to user %p at %llu\n", count, buf, *ppos);
-	*ppos += count;
-	return count;
+	struct ssd1963_fb *fb = container_of(info, struct ssd1963_fb, info);
+	void __user *argp = (void __user *)arg;
+	struct ssd1963_cmdbuf cb;
+	struct ssd1963_damage d;
+	struct ssd1963_wait w;
+	u32 mode;
+	int ret;
+
+	switch (cmd) {
+	case SSD1963_IOC_SUBMIT:
+		if (copy_from_user(&cb, argp, sizeof(cb)))
+			return -EFAULT;
+		ret = ssd1963_cmd_submit(fb, &cb);
+		if (!cb.seq)
+			return ret;
+		if (copy_to_user(argp, &cb, sizeof(cb)))
+			return -EFAULT;
+		return ret;
+	case SSD1963_IOC_WAIT:
+		if (copy_from_user(&w, argp, sizeof(w)))
+			return -EFAULT;
+		/* with info->lock held, userspace polls for longer waits */
+		if (w.timeout_ms <= SSD1963_WAIT_MAX_MS)
+			return ssd1963_cmd_wait(fb, &w);
+		w.timeout_ms = SSD1963_WAIT_MAX_MS;
+		ret = ssd1963_cmd_wait(fb, &w);
+		return ret == -ETIMEDOUT ? -EAGAIN : ret;
+	case SSD1963_IOC_DAMAGE:
+		if (copy_from_user(&d, argp, sizeof(d)))
+			return -EFAULT;
+		ret = ssd1963_damage_submit(fb, &d);
+		if (ret)
+			return ret;
+		return copy_to_user(argp, &d, sizeof(d)) ? -EFAULT : 0;
+	case SSD1963_IOC_MMAP_MODE:
+		if (get_user(mode, (u32 __user *)argp))
+			return -EFAULT;
+		if (mode > SSD1963_MMAP_DIRECT)
+			return -EINVAL;
+		/* the mode is the device's, not the caller's */
+		if (!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+		fb->mmap_direct = mode == SSD1963_MMAP_DIRECT;
+		return 0;
+	}
+	return -ENOTTY;
+}
+
+#ifdef CONFIG_COMPAT
+/* fbmem calls this without the lock its native path takes around fb_ioctl,
+ * which keeps set_par from changing the mode under a command buffer */
+static int ssd1963_fb_compat_ioctl(struct fb_info *info, unsigned int cmd,
+				   unsigned long arg)
+{
+	int ret;
+
+	if (!lock_fb_info(info))
+		return -ENODEV;
+	ret = ssd1963_fb_ioctl(info, cmd, (unsigned long)compat_ptr(arg));
+	unlock_fb_info(info);
+	return ret;
+}
+#endif
+
+/* for ssd1963_v4l2.c */
+struct fb_info * ssd1963_fb_info(void)
+{
+	return &this_fb.info;
+}
+
+/* The vblank op is queued first and, since ops go before the flush, makes
+ * the flush of the lines start in the vertical blanking. */
+u32 ssd1963_fb_present(u32 y, u32 h)
+{
+	struct ssd1963_fb *fb = &this_fb;
+	u32 seq;
+
+	mutex_lock(&fb->cmd_lock);
+	ssd1963_queue_op(fb, &(struct ssd1963_op){
+		.type = SSD1963_OP_VBLANK,
+	});
+	ssd1963_damage(fb, y, h, 0);
+	seq = ssd1963_cmd_fence(fb);
+	mutex_unlock(&fb->cmd_lock);
+	return seq;
+}
+
+int ssd1963_fb_wait(u32 seq, u32 timeout_ms)
+{
+	return ssd1963_cmd_wait(&this_fb, &(struct ssd1963_wait){
+		.seq = seq,
+		.timeout_ms = timeout_ms,
+	});
+}
+
+/* fb_deferred_io_init() installs its mmap, which ssd1963_fb_mmap() replaces
+ * and calls unless SSD1963_MMAP_DIRECT was selected */
+static int (*ssd1963_defio_mmap)(struct fb_info *info,
+				 struct vm_area_struct *vma);
+
+/* without write protection, changes are only sent by SSD1963_IOC_DAMAGE */
+static int ssd1963_fb_mmap(struct fb_info *info, struct vm_area_struct *vma)
+{
+	struct ssd1963_fb *fb = container_of(info, struct ssd1963_fb, info);
+	unsigned long pages = fb->shadow_size >> PAGE_SHIFT;
+
+	if (!fb->mmap_direct)
+		return ssd1963_defio_mmap(info, vma);
+	if (vma->vm_pgoff > pages || vma_pages(vma) > pages - vma->vm_pgoff)
+		return -EINVAL;
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+	return remap_vmalloc_range(vma, fb->shadow, vma->vm_pgoff);
 }
 
 static struct fb_ops ssd1963_fb_ops = {
@@ -663,17 +3229,483 @@ static struct fb_ops ssd1963_fb_ops = {
 	.fb_check_var	= ssd1963_fb_check_var,
 	.fb_set_par	= ssd1963_fb_set_par,
 	.fb_setcolreg	= ssd1963_fb_setcolreg,
+	.fb_setcmap	= ssd1963_fb_setcmap,
 	.fb_blank	= ssd1963_fb_blank,
 	.fb_fillrect	= ssd1963_fb_fillrect,
 	.fb_imageblit	= ssd1963_fb_imageblit,
+	.fb_cursor	= ssd1963_fb_cursor,
 	.fb_pan_display	= ssd1963_fb_pan_display,
 	.fb_copyarea	= ssd1963_fb_copyarea,
-	.fb_read	= ssd1963_fb_read,
+	.fb_sync	= ssd1963_fb_sync,
+	.fb_read	= fb_sys_read,
 	.fb_write	= ssd1963_fb_write,
-	/* Rotates the display *//*
-	void (*fb_rotate)(struct fb_info *info, int angle);*/
+	.fb_rotate	= ssd1963_fb_rotate,
+	.fb_ioctl	= ssd1963_fb_ioctl,
+#ifdef CONFIG_COMPAT
+	.fb_compat_ioctl = ssd1963_fb_compat_ioctl,
+#endif
+};
+
+/* --------------------------------------------------------------------------
+ * benchmark
+ * -------------------------------------------------------------------------- */
+
+/* Writing a pattern's name (or "all") to bench/run draws it bench/frames times
+ * through the fb ops, the way fbcon and X do, each frame waited for until it
+ * reached the panel. A line per pattern is added to bench/results, tagged
+ * with bus_wait so that timings can be compared. Rates are of the pixels
+ * drawn, in the bits the bus format takes for them; the flush's diff may send
+ * less. The console is held off while a frame is drawn and its content
+ * restored after; a mode change ends the run with EBUSY. */
+#define SSD1963_BENCH_RESULTS	32
+#define SSD1963_BENCH_GLYPHS	64 /* different 8x16 bitmaps */
+
+struct ssd1963_bench {
+	struct fb_info *info;
+	u32 *img;                  /* XRGB8888 frame for the gradient */
+	u8 glyphs[SSD1963_BENCH_GLYPHS][16];
+	u32 color;
+	u64 px, ops;
+	/* the mode the run started in */
+	struct fb_var_screeninfo var;
+	u32 line_length;
+	size_t size;
+};
+
+struct ssd1963_bench_result {
+	const char *pattern;
+	unsigned bus_wait, bus_bits, frames;
+	u64 ns, px, ops;
+};
+
+static DEFINE_MUTEX(ssd1963_bench_lock);
+static unsigned ssd1963_bench_frames = 30;
+static unsigned ssd1963_bench_n;   /* results ever, the last ones kept */
+static struct ssd1963_bench_result ssd1963_bench_res[SSD1963_BENCH_RESULTS];
+
+static void ssd1963_bench_rect(struct ssd1963_bench *b, u32 x, u32 y, u32 w,
+			       u32 h, u32 color)
+{
+	ssd1963_fb_fillrect(b->info, &(struct fb_fillrect){
+		.dx = x, .dy = y, .width = w, .height = h,
+		.color = color, .rop = ROP_COPY,
+	});
+	b->px += w * h;
+	b->ops++;
+}
+
+/* a palette index differing from the last one */
+static u32 ssd1963_bench_color(struct ssd1963_bench *b)
+{
+	b->color = (b->color + 1 + prandom_u32() % 15) % 16;
+	return b->color;
+}
+
+static void ssd1963_bench_fill(struct ssd1963_bench *b, unsigned frame)
+{
+	const struct fb_var_screeninfo *var = &b->info->var;
+
+	ssd1963_bench_rect(b, 0, 0, var->xres, var->yres, frame & 1 ? 15 : 0);
+}
+
+static void ssd1963_bench_randfill(struct ssd1963_bench *b, unsigned frame)
+{
+	const struct fb_var_screeninfo *var = &b->info->var;
+
+	ssd1963_bench_rect(b, 0, 0, var->xres, var->yres,
+			   ssd1963_bench_color(b));
+}
+
+static void ssd1963_bench_gradient(struct ssd1963_bench *b, unsigned frame)
+{
+	const struct fb_var_screeninfo *var = &b->info->var;
+	u32 x, y, *p = b->img;
+
+	for (y = 0; y < var->yres; y++)
+		for (x = 0; x < var->xres; x++)
+			*p++ = ((x + frame * 8) & 0xff) << 16 |
+			       ((y + frame * 4) & 0xff) << 8 |
+			       ((x + y) / 4 & 0xff);
+	ssd1963_fb_imageblit(b->info, &(struct fb_image){
+		.width = var->xres, .height = var->yres,
+		.depth = 32, .data = (const char *)b->img,
+	});
+	b->px += var->xres * var->yres;
+	b->ops++;
+}
+
+/* the screen full of console glyphs */
+static void ssd1963_bench_glyphs(struct ssd1963_bench *b, unsigned frame)
+{
+	const struct fb_var_screeninfo *var = &b->info->var;
+	struct fb_image img = { .width = 8, .height = 16, .depth = 1 };
+	u32 x, y;
+
+	for (y = 0; y + 16 <= var->yres; y += 16)
+		for (x = 0; x + 8 <= var->xres; x += 8) {
+			img.dx = x;
+			img.dy = y;
+			img.bg_color = ssd1963_bench_color(b);
+			img.fg_color = ssd1963_bench_color(b);
+			img.data = (const char *)b->glyphs[prandom_u32() %
+						SSD1963_BENCH_GLYPHS];
+			ssd1963_fb_imageblit(b->info, &img);
+			b->px += 8 * 16;
+			b->ops++;
+		}
+}
+
+static void ssd1963_bench_scatter(struct ssd1963_bench *b, u32 max, u32 n)
+{
+	const struct fb_var_screeninfo *var = &b->info->var;
+	u32 w, h;
+
+	while (n--) {
+		w = 1 + prandom_u32() % max;
+		h = 1 + prandom_u32() % max;
+		ssd1963_bench_rect(b, prandom_u32() % (var->xres - w + 1),
+				   prandom_u32() % (var->yres - h + 1), w, h,
+				   ssd1963_bench_color(b));
+	}
+}
+
+static void ssd1963_bench_rects(struct ssd1963_bench *b, unsigned frame)
+{
+	ssd1963_bench_scatter(b, 32, 256);
+}
+
+/* single pixels, i.e. the cost of opening a window per op */
+static void ssd1963_bench_cmd(struct ssd1963_bench *b, unsigned frame)
+{
+	ssd1963_bench_scatter(b, 1, 1024);
+}
+
+static const struct ssd1963_bench_pattern {
+	const char *name;
+	void (*draw)(struct ssd1963_bench *b, unsigned frame);
+} ssd1963_bench_patterns[] = {
+	{ "fill",     ssd1963_bench_fill },
+	{ "randfill", ssd1963_bench_randfill },
+	{ "gradient", ssd1963_bench_gradient },
+	{ "glyphs",   ssd1963_bench_glyphs },
+	{ "rects",    ssd1963_bench_rects },
+	{ "cmd",      ssd1963_bench_cmd },
+};
+
+/* With ssd1963_bench_lock held. Takes the console lock for each frame,
+ * which fails with -EBUSY if the panel or the mode changed since the run
+ * started. */
+static int ssd1963_bench_lock_frame(struct ssd1963_bench *b)
+{
+	const struct fb_var_screeninfo *var = &b->info->var;
+
+	console_lock();
+	if (b->info->state != FBINFO_STATE_RUNNING ||
+	    this_fb.pm_state != SSD1963_PM_ON ||
+	    var->xres != b->var.xres || var->yres != b->var.yres ||
+	    var->yres_virtual != b->var.yres_virtual ||
+	    var->bits_per_pixel != b->var.bits_per_pixel ||
+	    var->rotate != b->var.rotate ||
+	    b->info->fix.line_length != b->line_length) {
+		console_unlock();
+		return -EBUSY;
+	}
+	return 0;
+}
+
+/* with ssd1963_bench_lock held */
+static int ssd1963_bench_pattern(struct ssd1963_bench *b,
+				 const struct ssd1963_bench_pattern *pt)
+{
+	struct ssd1963_bench_result *r;
+	unsigned frames = ssd1963_bench_frames, i;
+	ktime_t t;
+	int ret;
+
+	b->px = b->ops = 0;
+	ssd1963_fb_sync(b->info);
+	t = ktime_get();
+	for (i = 0; i < frames; i++) {
+		ret = ssd1963_bench_lock_frame(b);
+		if (ret)
+			return ret;
+		pt->draw(b, i);
+		console_unlock();
+		ssd1963_fb_sync(b->info);
+	}
+
+	r = &ssd1963_bench_res[ssd1963_bench_n++ % SSD1963_BENCH_RESULTS];
+	r->ns = max_t(s64, ktime_to_ns(ktime_sub(ktime_get(), t)), 1);
+	r->pattern = pt->name;
+	r->bus_wait = bus_wait;
+	r->bus_bits = ssd1963_px_words2() *
+		      ssd_bus_fmt_width(this_fb.pdata->bus_fmt) / 2;
+	r->frames = frames;
+	r->px = b->px;
+	r->ops = b->ops;
+	return 0;
+}
+
+static int ssd1963_bench_run(const char *name)
+{
+	struct ssd1963_fb *fb = &this_fb;
+	struct fb_info *info = &fb->info;
+	struct ssd1963_bench *b;
+	void *saved = NULL;
+	unsigned i, n = 0;
+	int ret = 0;
+
+	b = vzalloc(sizeof(*b));
+	if (!b)
+		return -ENOMEM;
+	b->info = info;
+	prandom_bytes(b->glyphs, sizeof(b->glyphs));
+
+	console_lock();
+	if (info->state != FBINFO_STATE_RUNNING ||
+	    fb->pm_state != SSD1963_PM_ON) {
+		console_unlock();
+		ret = -EBUSY;
+		goto out;
+	}
+	b->var = info->var;
+	b->line_length = info->fix.line_length;
+	b->size = info->screen_size;
+	saved = vmalloc(b->size);
+	b->img = vmalloc(info->var.xres * info->var.yres * 4);
+	if (!saved || !b->img) {
+		console_unlock();
+		ret = -ENOMEM;
+		goto out;
+	}
+	ssd1963_fb_sync(info);
+	memcpy(saved, fb->shadow, b->size);
+	console_unlock();
+
+	for (i = 0; i < ARRAY_SIZE(ssd1963_bench_patterns) && !ret; i++) {
+		if (strcmp(name, "all") &&
+		    strcmp(name, ssd1963_bench_patterns[i].name))
+			continue;
+		/* palette indices can't take the 32 bit image */
+		if (ssd1963_bench_patterns[i].draw == ssd1963_bench_gradient &&
+		    b->var.bits_per_pixel <= 8)
+			continue;
+		ret = ssd1963_bench_pattern(b, &ssd1963_bench_patterns[i]);
+		n++;
+	}
+	if (!n)
+		ret = -EINVAL;
+
+	/* the console's content, unless the mode changed meanwhile; what it
+	 * printed during the run was drawn over */
+	if (!ssd1963_bench_lock_frame(b)) {
+		memcpy(fb->shadow, saved, b->size);
+		ssd1963_damage(fb, 0, b->var.yres_virtual, 0);
+		console_unlock();
+	}
+out:
+	vfree(b->img);
+	vfree(b);
+	vfree(saved);
+	return ret;
+}
+
+/* a pattern's name, "all", or "clear" to drop the results */
+static ssize_t ssd1963_bench_run_store(struct device *dev,
+				       struct device_attribute *attr,
+				       const char *buf, size_t count)
+{
+	char name[16], *n;
+	int ret = 0;
+
+	strlcpy(name, buf, sizeof(name));
+	n = strim(name);
+	if (!this_fb.registered)
+		return -ENODEV;
+
+	mutex_lock(&ssd1963_bench_lock);
+	if (!strcmp(n, "clear"))
+		ssd1963_bench_n = 0;
+	else
+		ret = ssd1963_bench_run(n);
+	mutex_unlock(&ssd1963_bench_lock);
+
+	return ret ? ret : count;
+}
+static DEVICE_ATTR(run, S_IWUSR, NULL, ssd1963_bench_run_store);
+
+static ssize_t ssd1963_bench_frames_show(struct device *dev,
+					 struct device_attribute *attr,
+					 char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", ssd1963_bench_frames);
+}
+
+static ssize_t ssd1963_bench_frames_store(struct device *dev,
+					  struct device_attribute *attr,
+					  const char *buf, size_t count)
+{
+	unsigned v;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &v);
+	if (ret)
+		return ret;
+	if (!v || v > 10000)
+		return -EINVAL;
+	mutex_lock(&ssd1963_bench_lock);
+	ssd1963_bench_frames = v;
+	mutex_unlock(&ssd1963_bench_lock);
+	return count;
+}
+static DEVICE_ATTR(frames, S_IRUGO | S_IWUSR, ssd1963_bench_frames_show,
+		   ssd1963_bench_frames_store);
+
+/* per second * 100, in us not to overflow */
+static inline u64 ssd1963_bench_rate(u64 v, u64 ns)
+{
+	return div64_u64(v * 100 * USEC_PER_SEC,
+			 max_t(u64, div_u64(ns, NSEC_PER_USEC), 1));
+}
+
+static ssize_t ssd1963_bench_results_show(struct device *dev,
+					  struct device_attribute *attr,
+					  char *buf)
+{
+	const struct ssd1963_bench_result *r;
+	unsigned i, n;
+	ssize_t len;
+	u64 mbs, fps;
+	u32 mbs_frac, fps_frac;
+
+	mutex_lock(&ssd1963_bench_lock);
+	len = scnprintf(buf, PAGE_SIZE, "%-8s %8s %6s %8s %10s %8s %9s %8s "
+			"%7s\n", "pattern", "bus_wait", "frames", "ms", "px/s",
+			"MB/s", "ops/s", "ns/op", "fps");
+	n = min_t(unsigned, ssd1963_bench_n, SSD1963_BENCH_RESULTS);
+	for (i = ssd1963_bench_n - n; i < ssd1963_bench_n; i++) {
+		r = &ssd1963_bench_res[i % SSD1963_BENCH_RESULTS];
+		/* no plain 64 bit divisions on 32 bit ARM */
+		mbs = div_u64_rem(div_u64(ssd1963_bench_rate(r->px *
+							     r->bus_bits,
+							     r->ns),
+					  8 * 1000000), 100, &mbs_frac);
+		fps = div_u64_rem(ssd1963_bench_rate(r->frames, r->ns), 100,
+				  &fps_frac);
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+			"%-8s %8u %6u %8llu %10llu %5llu.%02u %9llu %8llu "
+			"%4llu.%02u\n", r->pattern, r->bus_wait, r->frames,
+			div_u64(r->ns, NSEC_PER_MSEC),
+			div_u64(ssd1963_bench_rate(r->px, r->ns), 100),
+			mbs, mbs_frac,
+			div_u64(ssd1963_bench_rate(r->ops, r->ns), 100),
+			div64_u64(r->ns, max_t(u64, r->ops, 1)),
+			fps, fps_frac);
+	}
+	mutex_unlock(&ssd1963_bench_lock);
+	return len;
+}
+static DEVICE_ATTR(results, S_IRUGO, ssd1963_bench_results_show, NULL);
+
+static struct attribute *ssd1963_bench_attrs[] = {
+	&dev_attr_run.attr,
+	&dev_attr_frames.attr,
+	&dev_attr_results.attr,
+	NULL,
+};
+
+static const struct attribute_group ssd1963_bench_attr_group = {
+	.name = "bench",
+	.attrs = ssd1963_bench_attrs,
 };
 
+static unsigned rotate;
+module_param(rotate, uint, S_IRUGO);
+MODULE_PARM_DESC(rotate, "initial rotation, 0: none, 1: 90, 2: 180, "
+	"3: 270 degrees clockwise (default: 0)");
+
+static unsigned scale = 1;
+module_param(scale, uint, S_IRUGO);
+MODULE_PARM_DESC(scale, "initial resolution is the panel's divided by this, "
+	"each pixel shown as scale x scale (default: 1)");
+
+static bool handover = 1;
+module_param(handover, bool, S_IRUGO);
+MODULE_PARM_DESC(handover, "keep the controller's configuration and GRAM if "
+	"it already runs in the requested mode and leave it running on "
+	"unload, needs rd_pin (default: 1)");
+
+/* Whether the controller (e.g. set up by the bootloader or before a module
+ * reload) already runs with the mode in fb->iv and our interface format and
+ * is awake. */
+static int ssd1963_hw_running(struct ssd1963_fb *fb)
+{
+	int v;
+
+	if (ssd_iv_matches_hw(&fb->iv) != 1)
+		return 0;
+
+	SSD_GET_PIXEL_DATA_INTERFACE();
+	v = ssd_rd_slow_data();
+	if (v < 0 || (v & 0x07) != fb->pdata->bus_fmt)
+		return 0;
+
+	/* sleep out and display on */
+	SSD_GET_POWER_MODE();
+	v = ssd_rd_slow_data();
+	return v >= 0 && (v & 0x14) == 0x14;
+}
+
+static bool skip_clear;
+module_param(skip_clear, bool, S_IRUGO);
+MODULE_PARM_DESC(skip_clear, "don't clear the screen on probe, e.g. when a "
+	"splash is drawn right away (default: 0)");
+
+static void ssd1963_fb_stop_worker(struct ssd1963_fb *fb)
+{
+	if (!fb->worker)
+		return;
+	ssd1963_fb_sync(&fb->info);
+	kthread_stop(fb->worker);
+	fb->worker = NULL;
+	ssd1963_pipe_stop(fb);
+}
+
+static void ssd1963_shadow_free(struct ssd1963_fb *fb)
+{
+	vfree(fb->shadow);
+	vfree(fb->prev);
+	kfree(fb->linebuf);
+	fb->shadow = fb->prev = fb->linebuf = NULL;
+}
+
+/* large enough for any mode check_var() accepts */
+static int ssd1963_shadow_alloc(struct ssd1963_fb *fb)
+{
+	const struct ssd_display *lcd = &fb->pdata->lcd;
+	u32 Bpp = DIV_ROUND_UP(fb->info.var.bits_per_pixel, 8);
+
+	/* the longest line of either orientation, word aligned; spanned
+	 * panels are not rotated */
+	if (fb->ntiles > 1)
+		fb->shadow_size = PAGE_ALIGN(
+			ALIGN(lcd->hori.visible * fb->tiles_x * Bpp, 4) *
+			lcd->vert.visible * fb->tiles_y);
+	else
+		fb->shadow_size = PAGE_ALIGN(max(
+			ALIGN(lcd->hori.visible * Bpp, 4) * lcd->vert.visible,
+			ALIGN(lcd->vert.visible * Bpp, 4) * lcd->hori.visible));
+	/* zeroed, and mappable by ssd1963_fb_mmap() */
+	fb->shadow = vmalloc_user(fb->shadow_size);
+	fb->prev = vzalloc(fb->shadow_size);
+	fb->linebuf = kmalloc(SSD1963_MAX_WIDTH * fb->tiles_x * 4, GFP_KERNEL);
+	if (!fb->shadow || !fb->prev || !fb->linebuf) {
+		ssd1963_shadow_free(fb);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
 static int ssd1963_fb_register(void)
 {
 	struct ssd1963_fb *fb = &this_fb;
@@ -684,7 +3716,8 @@ static int ssd1963_fb_register(void)
 	fb->info.fbops			= &ssd1963_fb_ops;
 	fb->info.flags			= FBINFO_FLAG_DEFAULT
 					| FBINFO_HWACCEL_YWRAP
-					| FBINFO_HWACCEL_COPYAREA; /* TODO: hack since SCROLL_WRAP_REDRAW isn't implemented in fbcon.c yet :/ */
+					| FBINFO_HWACCEL_COPYAREA /* TODO: hack since SCROLL_WRAP_REDRAW isn't implemented in fbcon.c yet :/ */
+					| FBINFO_VIRTFB;
 	fb->info.pseudo_palette		= fb->cmap;
 
 	strncpy(fb->info.fix.id, ssd1963_name, sizeof(fb->info.fix.id));
@@ -695,8 +3728,23 @@ static int ssd1963_fb_register(void)
 	fb->info.fix.ywrapstep		= 1;
 	fb->info.fix.accel		= FB_ACCEL_NONE;
 
-	fb->info.var.xres		= pdata->lcd.hori.visible;
-	fb->info.var.yres		= pdata->lcd.vert.visible;
+	if (!scale || pdata->lcd.hori.visible % scale ||
+	    pdata->lcd.vert.visible % scale || fb->ntiles > 1) {
+		if (scale != 1)
+			dev_warn(&fb->dev->dev, "cannot scale by %u\n", scale);
+		scale = 1;
+	}
+	if (fb->ntiles > 1 && (rotate & 3) != FB_ROTATE_UR) {
+		dev_warn(&fb->dev->dev, "spanned panels cannot be rotated\n");
+		rotate = FB_ROTATE_UR;
+	}
+	fb->info.var.rotate		= rotate & 3;
+	fb->info.var.xres		= pdata->lcd.hori.visible / scale *
+					  fb->tiles_x;
+	fb->info.var.yres		= pdata->lcd.vert.visible / scale *
+					  fb->tiles_y;
+	if (ssd1963_rotated_90(&fb->info.var))
+		swap(fb->info.var.xres, fb->info.var.yres);
 #if 0
 	fb->info.var.xres_virtual	= SSD1963_MAX_WIDTH;
 	fb->info.var.yres_virtual	= SSD1963_MAX_HEIGHT;
@@ -704,7 +3752,7 @@ static int ssd1963_fb_register(void)
 	fb->info.var.xres_virtual	= fb->info.var.xres;
 	fb->info.var.yres_virtual	= fb->info.var.yres;
 #endif
-	fb->info.var.bits_per_pixel	= 32;
+	fb->info.var.bits_per_pixel	= ssd1963_default_bpp();
 	fb->info.var.vmode		= FB_VMODE_NONINTERLACED;
 	fb->info.var.activate		= FB_ACTIVATE_NOW;
 	fb->info.var.nonstd		= 0;
@@ -737,50 +3785,84 @@ static int ssd1963_fb_register(void)
 
 	switch (pdata->bus_fmt) {
 	case SSD_DATA_8:
-		ssd1963_px_wr = ssd1963_px_wr8; break;
+		ssd1963_px_wr = ssd1963_px_wr8;
+		ssd1963_px_enc = ssd1963_px_enc8; break;
 	case SSD_DATA_9:
-		ssd1963_px_wr = ssd1963_px_wr9; break;
+		ssd1963_px_wr = ssd1963_px_wr9;
+		ssd1963_px_enc = ssd1963_px_enc9; break;
 	case SSD_DATA_12:
-		ssd1963_px_wr = ssd1963_px_wr12; break;
+		ssd1963_px_wr = ssd1963_px_wr12;
+		ssd1963_px_enc = ssd1963_px_enc12; break;
 	case SSD_DATA_16_PACKED:
-		ssd1963_px_wr = ssd1963_px_wr16_packed; break;
+		ssd1963_px_wr = ssd1963_px_wr16_packed;
+		ssd1963_px_enc = ssd1963_px_enc16_packed; break;
 	case SSD_DATA_16_565:
 	case SSD_DATA_18:
 	case SSD_DATA_24:
-		ssd1963_px_wr = ssd1963_px_wr1; break;
+		ssd1963_px_wr = ssd1963_px_wr1;
+		ssd1963_px_enc = ssd1963_px_enc1; break;
 	}
 
+	ret = ssd1963_shadow_alloc(fb);
+	if (ret)
+		goto fail;
+
 	ret = ssd1963_fb_check_var(&fb->info.var, &fb->info);
 	print_debug("SSD1963FB: set_var: %d\n", ret);
 	if (ret)
-		goto fail;
+		goto free_shadow;
 
-	err = ssd_init_pll(&fb->iv);
-	print_debug("init_pll: %s\n", ssd_strerr(err));
-	if (err) {
-		ret = -EINVAL;
-		goto fail;
+	if (handover && ssd1963_hw_running(fb)) {
+		dev_info(&fb->dev->dev, "controller already set up, taking "
+			 "over its configuration and GRAM\n");
+		fb->warm = 1;
+	} else {
+		err = ssd1963_hw_init_pll(fb);
+		print_debug("init_pll: %s\n", ssd_strerr(err));
+		if (err) {
+			ret = -EINVAL;
+			goto free_shadow;
+		}
 	}
 
-	SSD_SET_ADDRESS_MODE(pdata->lcd_addr_mode);
-	SSD_SET_PIXEL_DATA_INTERFACE(pdata->bus_fmt);
-
 	ret = ssd1963_fb_set_par(&fb->info);
 	print_debug("SSD1963FB: set_par: %d\n", ret);
 	if (ret)
-		goto fail;
+		goto free_shadow;
 
 	fb_set_cmap(&fb->info.cmap, &fb->info);
 
-	/* clear framebuffer */
-	ssd1963_fb_fillrect(&fb->info, &(struct fb_fillrect){
-		0, 0, fb->info.var.xres, fb->info.var.yres, 0x000000, ROP_COPY
-	});
+	/* queued before registering, so it's ordered before fbcon's drawing;
+	 * when taken over, GRAM is unknown but kept until drawn over */
+	ssd1963_shadow_init_clear(fb, !skip_clear && !fb->warm);
+	fb->warm = 0;
+
+	ret = ssd1963_pipe_start(fb);
+	if (ret)
+		goto free_shadow;
+	fb->worker = kthread_run(ssd1963_fb_worker, fb, DRIVER_NAME);
+	if (IS_ERR(fb->worker)) {
+		ret = PTR_ERR(fb->worker);
+		fb->worker = NULL;
+		ssd1963_pipe_stop(fb);
+		goto free_shadow;
+	}
+
+	fb->defio.delay = HZ / 30;
+	fb->defio.deferred_io = ssd1963_fb_deferred_io;
+	fb->info.fbdefio = &fb->defio;
+	fb_deferred_io_init(&fb->info);
+	ssd1963_defio_mmap = ssd1963_fb_ops.fb_mmap;
+	ssd1963_fb_ops.fb_mmap = ssd1963_fb_mmap;
 
 	ret = register_framebuffer(&fb->info);
 	print_debug("SSD1963FB: register framebuffer (%d)\n", ret);
 	if (ret == 0)
 		goto out;
+	fb_deferred_io_cleanup(&fb->info);
+	ssd1963_fb_stop_worker(fb);
+free_shadow:
+	ssd1963_shadow_free(fb);
 fail:
 	print_debug("SSD1963FB: cannot register framebuffer (%d)\n", ret);
 out:
@@ -852,6 +3934,50 @@ out:
 	return ret;
 }
 
+static bool v4l2 = 1;
+module_param(v4l2, bool, S_IRUGO);
+MODULE_PARM_DESC(v4l2, "register a V4L2 video output node, if built with "
+	"videobuf2 (default: 1)");
+
+/* Initializing the controller takes most of the probe's time (PLL lock,
+ * reset, set_par), so it and the registration of the framebuffer are done
+ * asynchronously, off the module init path. */
+static void ssd1963_fb_probe_async(void *data, async_cookie_t cookie)
+{
+	struct platform_device *pdev = data;
+	int ret;
+
+	ret = ssd1963_fb_register();
+	if (ret) {
+		ssd1963_glyph_clear(&this_fb.glyphs);
+		ssd1963_gpio_bus_release(&pdev->dev, BUS_CTL_MASK | BUS_MASK);
+		dev_err(&pdev->dev, "probe failed, err %d\n", ret);
+		return;
+	}
+
+	ret = sysfs_create_group(&pdev->dev.kobj, &ssd1963_glyph_attr_group);
+	if (ret)
+		dev_warn(&pdev->dev, "cannot export glyph cache stats: %d\n",
+			 ret);
+	ret = sysfs_create_group(&pdev->dev.kobj, &ssd1963_bench_attr_group);
+	if (ret)
+		dev_warn(&pdev->dev, "cannot export the benchmark: %d\n", ret);
+	if (v4l2) {
+		ret = ssd1963_v4l2_register(&pdev->dev);
+		if (ret)
+			dev_warn(&pdev->dev, "cannot register V4L2 output: %d\n",
+				 ret);
+	}
+	this_fb.registered = 1;
+}
+
+/* waits for ssd1963_fb_probe_async(), returns whether it succeeded */
+static int ssd1963_fb_probe_sync(void)
+{
+	async_synchronize_cookie(this_fb.probe_cookie + 1);
+	return this_fb.registered;
+}
+
 static int ssd1963_fb_probe(struct platform_device *pdev)
 {
 	struct ssd1963_platform_data *pdata = pdev->dev.platform_data;
@@ -870,6 +3996,10 @@ static int ssd1963_fb_probe(struct platform_device *pdev)
 	 * speed since:
 	 * 1. gpiolib only supports setting one pin at a time
 	 * 2. bcm2708's <mach/gpio.h> doesn't even provide inline setters */
+	ret = ssd1963_bus_init(&pdev->dev, pdata);
+	if (ret)
+		goto fail;
+
 	ret = ssd1963_gpio_bus_request(&pdev->dev,
 				       BUS_CTL_MASK | BUS_MASK,
 				       BUS_CTL_MASK | 0); /* 0 is SSD_NOP */
@@ -879,17 +4009,22 @@ static int ssd1963_fb_probe(struct platform_device *pdev)
 	memset(&this_fb, 0, sizeof(struct ssd1963_fb));
 	this_fb.dev = pdev;
 	this_fb.pdata = pdata;
-
-	ret = ssd1963_fb_register();
-	if (ret)
-		goto release_gpios;
+	this_fb.tiles_x = max_t(u32, pdata->tiles_x, 1);
+	this_fb.tiles_y = max_t(u32, pdata->tiles_y, 1);
+	this_fb.ntiles = this_fb.tiles_x * this_fb.tiles_y;
+	spin_lock_init(&this_fb.op_lock);
+	init_waitqueue_head(&this_fb.op_wq);
+	init_waitqueue_head(&this_fb.done_wq);
+	mutex_init(&this_fb.bus_lock);
+	mutex_init(&this_fb.cmd_lock);
+	ssd1963_glyph_init(&this_fb.glyphs);
+
+	this_fb.probe_cookie = async_schedule(ssd1963_fb_probe_async, pdev);
 
 	// platform_set_drvdata(pdev, fb);
+	ret = 0;
 	goto done;
 
-// free_region:
-release_gpios:
-	ssd1963_gpio_bus_release(&pdev->dev, BUS_CTL_MASK | BUS_MASK);
 fail:
 	dev_err(&pdev->dev, "probe failed, err %d\n", ret);
 done:
@@ -902,9 +4037,22 @@ static int ssd1963_fb_remove(struct platform_device *pdev)
 
 	// platform_set_drvdata(pdev, NULL);
 
+	/* otherwise the async probe already cleaned up */
+	if (!ssd1963_fb_probe_sync())
+		return 0;
+
+	ssd1963_v4l2_unregister();
+	sysfs_remove_group(&pdev->dev.kobj, &ssd1963_bench_attr_group);
+	sysfs_remove_group(&pdev->dev.kobj, &ssd1963_glyph_attr_group);
 	unregister_framebuffer(&this_fb.info);
+	fb_deferred_io_cleanup(&this_fb.info);
+	ssd1963_fb_stop_worker(&this_fb);
+	ssd1963_glyph_clear(&this_fb.glyphs);
+	ssd1963_shadow_free(&this_fb);
 
-	SSD_ENTER_SLEEP_MODE();
+	/* left running for the next load to take over */
+	if (!handover || BUS_RD_MASK == 0)
+		SSD_ENTER_SLEEP_MODE();
 
 	ssd1963_gpio_bus_release(&pdev->dev, BUS_CTL_MASK | BUS_MASK);
 
@@ -915,12 +4063,94 @@ static int ssd1963_fb_remove(struct platform_device *pdev)
 	return 0;
 }
 
+static bool deep_sleep;
+module_param(deep_sleep, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(deep_sleep, "suspend to deep sleep (PLL off, GRAM has to be "
+	"resent) instead of sleep mode (default: 0)");
+
+static int ssd1963_fb_suspend(struct device *dev)
+{
+	struct ssd1963_fb *fb = &this_fb;
+
+	if (!ssd1963_fb_probe_sync())
+		return 0;
+
+	console_lock();
+	fb_set_suspend(&fb->info, 1);
+	console_unlock();
+
+	ssd1963_fb_sync(&fb->info);
+	mutex_lock(&fb->bus_lock);
+	fb->par_sent_valid = 0;
+	SSD_SET_DISPLAY_OFF();
+	SSD_ENTER_SLEEP_MODE();
+	msleep(5);
+	if (deep_sleep) {
+		SSD_SET_PLL(0x00);
+		SSD_SET_DEEP_SLEEP();
+		fb->pm_state = SSD1963_PM_DEEP_SLEEP;
+	} else {
+		fb->pm_state = SSD1963_PM_SLEEP;
+	}
+	mutex_unlock(&fb->bus_lock);
+
+	return 0;
+}
+
+/* Out of sleep mode the registers and GRAM are still valid. From deep sleep
+ * the cached state (iv, var, pdata) is replayed, waiting for the PLL only as
+ * long as it takes to lock, and all lines are resent. fbcon's redraw on
+ * fb_set_suspend() only goes through the diff, so it costs no bus traffic for
+ * unchanged content. */
+static int ssd1963_fb_resume(struct device *dev)
+{
+	struct ssd1963_fb *fb = &this_fb;
+	enum ssd_err err = SSD_ERR_NONE;
+
+	if (!ssd1963_fb_probe_sync())
+		return 0;
+
+	mutex_lock(&fb->bus_lock);
+	if (fb->pm_state == SSD1963_PM_DEEP_SLEEP) {
+		/* any write wakes it up, give it time like a reset */
+		SSD_NOP();
+		SSD_NOP();
+		msleep(5);
+		err = ssd1963_hw_init_pll(fb);
+		if (!err)
+			err = ssd1963_hw_set_par(&fb->info);
+		ssd1963_shadow_invalidate(fb);
+	} else if (fb->pm_state == SSD1963_PM_SLEEP) {
+		SSD_EXIT_SLEEP_MODE();
+		msleep(5);
+		SSD_SET_DISPLAY_ON();
+	}
+	fb->pm_state = SSD1963_PM_ON;
+	mutex_unlock(&fb->bus_lock);
+	wake_up(&fb->op_wq);
+
+	if (err)
+		dev_err(dev, "resume: %s\n", ssd_strerr(err));
+
+	console_lock();
+	fb->diff_only = 1;
+	fb_set_suspend(&fb->info, 0);
+	fb->diff_only = 0;
+	console_unlock();
+
+	return err ? -EIO : 0;
+}
+
+static SIMPLE_DEV_PM_OPS(ssd1963_fb_pm_ops, ssd1963_fb_suspend,
+			 ssd1963_fb_resume);
+
 static struct platform_driver ssd1963_fb_driver = {
 	.probe = ssd1963_fb_probe,
 	.remove = ssd1963_fb_remove,
 	.driver = {
 		.name = DRIVER_NAME,
 		.owner = THIS_MODULE,
+		.pm = &ssd1963_fb_pm_ops,
 	},
 };
 
@@ -932,8 +4162,47 @@ static struct ssd1963_platform_data ssd_pdev_data = {
 	.pll_m		= 40,
 	.pll_n		= 5,
 	.pll_as_sysclk	= 1,
+	/* 22-25, 28-31; the 9 bit wiring used 22-25, 27-31 */
+	.bus_width	= 8,
+	.data_pins	= { 22, 23, 24, 25, 28, 29, 30, 31 },
+	.dc_pin		= 17,
+	.wr_pin		= 18,
+	.rd_pin		= SSD1963_PIN_NONE,
 };
 
+/* wiring overrides for boards with wider buses, e.g. 16 bit 565:
+ * bus_fmt=3 bus_pins=2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,19 */
+static int bus_fmt = -1;
+module_param(bus_fmt, int, S_IRUGO);
+MODULE_PARM_DESC(bus_fmt, "SSD_DATA_* pixel data interface format, "
+	"0: 8 bit, 1: 12 bit, 2: 16 bit packed, 3: 16 bit 565, "
+	"4: 18 bit, 5: 24 bit, 6: 9 bit (default: 0)");
+
+static int bus_pins[SSD1963_MAX_BUS_WIDTH];
+static int bus_pins_n;
+module_param_array(bus_pins, int, &bus_pins_n, S_IRUGO);
+MODULE_PARM_DESC(bus_pins, "GPIOs connected to D0, D1, ..., the count "
+	"determines the bus width (default: 22-25,28-31)");
+
+static int rd_pin = -1;
+module_param(rd_pin, int, S_IRUGO);
+MODULE_PARM_DESC(rd_pin, "GPIO connected to #RD, enables reading from the "
+	"controller (default: none)");
+
+/* spanning several panels, e.g. two 8 bit buses side by side:
+ * tiles_x=2 tile_pins=2,3,4,5,6,7,8,9,10,11 */
+static unsigned tiles_x = 1, tiles_y = 1;
+module_param(tiles_x, uint, S_IRUGO);
+MODULE_PARM_DESC(tiles_x, "panels spanned horizontally (default: 1)");
+module_param(tiles_y, uint, S_IRUGO);
+MODULE_PARM_DESC(tiles_y, "panels spanned vertically (default: 1)");
+
+static int tile_pins[(SSD1963_MAX_TILES - 1) * (SSD1963_MAX_BUS_WIDTH + 2)];
+static int tile_pins_n;
+module_param_array(tile_pins, int, &tile_pins_n, S_IRUGO);
+MODULE_PARM_DESC(tile_pins, "GPIOs connected to D0, D1, ..., #DC and #WR of "
+	"each further panel, in rows of tiles_x");
+
 static void ssd_pdev_release(struct device *dev)
 {
 	(void)dev;
@@ -949,6 +4218,43 @@ static struct platform_device ssd_pdev = {
 static int __init ssd1963_fb_init(void)
 {
 	int err = 0;
+	unsigned n;
+	int i;
+
+	ssd1963_bit_runs_init();
+
+	if (bus_fmt >= 0)
+		ssd_pdev_data.bus_fmt = bus_fmt;
+	if (bus_pins_n) {
+		ssd_pdev_data.bus_width = bus_pins_n;
+		for (i = 0; i < bus_pins_n; i++)
+			ssd_pdev_data.data_pins[i] = bus_pins[i];
+	}
+
+	if (rd_pin >= 0)
+		ssd_pdev_data.rd_pin = rd_pin;
+
+	n = tiles_x * tiles_y;
+	if (!tiles_x || !tiles_y || n > SSD1963_MAX_TILES ||
+	    tile_pins_n != (n - 1) * (ssd_pdev_data.bus_width + 2)) {
+		pr_err("ssd1963: %ux%u panels need %u tile_pins\n", tiles_x,
+			tiles_y, (n - 1) * (ssd_pdev_data.bus_width + 2));
+		return -EINVAL;
+	}
+	ssd_pdev_data.tiles_x = tiles_x;
+	ssd_pdev_data.tiles_y = tiles_y;
+	for (i = 0; i < tile_pins_n; i++) {
+		struct ssd1963_tile_pins *tp = &ssd_pdev_data.tile_pins[
+			i / (ssd_pdev_data.bus_width + 2)];
+		unsigned j = i % (ssd_pdev_data.bus_width + 2);
+
+		if (j < ssd_pdev_data.bus_width)
+			tp->data_pins[j] = tile_pins[i];
+		else if (j == ssd_pdev_data.bus_width)
+			tp->dc_pin = tile_pins[i];
+		else
+			tp->wr_pin = tile_pins[i];
+	}
 
 	err = platform_device_register(&ssd_pdev);
 
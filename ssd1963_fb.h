@@ -2,13 +2,19 @@
 #ifndef SSD1963_FB_H
 #define SSD1963_FB_H
 
-typedef u8	uint_least8_t;
-typedef u16	uint_least16_t;
-typedef u32	uint_least32_t;
-typedef u64	uint_least64_t;
+#include "ssd1963_port.h"
 
 #include "ssd1963.h"
 
+#define SSD1963_MAX_BUS_WIDTH	24
+#define SSD1963_MAX_TILES	4
+
+/* wiring of a further panel spanned by the framebuffer */
+struct ssd1963_tile_pins {
+	u8 data_pins[SSD1963_MAX_BUS_WIDTH];
+	u8 dc_pin, wr_pin;
+};
+
 struct ssd1963_platform_data {
 	struct ssd_display lcd;
 	enum ssd_address_mode lcd_addr_mode;
@@ -16,8 +22,28 @@ struct ssd1963_platform_data {
 	u32 xtal_freq;
 	u8 pll_m, pll_n;
 	char pll_as_sysclk;
+	/* wiring, all pins are bank 0 GPIOs */
+	u8 bus_width; /* number of connected data lines, >= bus_fmt's width */
+	u8 data_pins[SSD1963_MAX_BUS_WIDTH]; /* D0, D1, ... */
+	u8 dc_pin, wr_pin;
+	u8 rd_pin; /* SSD1963_PIN_NONE if the controller can't be read */
+	/* Panels of the same type spanned by one framebuffer, in rows of
+	 * tiles_x (0 is 1), each with its own bus of the above format. The
+	 * first is wired as above, the others to tile_pins[] and cannot be
+	 * read. */
+	u8 tiles_x, tiles_y;
+	struct ssd1963_tile_pins tile_pins[SSD1963_MAX_TILES - 1];
 };
 
+#define SSD1963_PIN_NONE	0xff
+
+/* BCM2708 GPIO registers used, byte offsets into the GPIO block */
+#define SSD_GPIO_FSEL(n)	(4 * (n))
+#define SSD_GPIO_SET0		0x1c
+#define SSD_GPIO_CLR0		0x28
+#define SSD_GPIO_LEV0		0x34
+#define SSD_GPIO_SIZE		0xb4
+
 #define SSD1963_FB_DRIVER_NAME	"ssd1963_fb"
 
 #define SSD1963_MAX_WIDTH	864
@@ -29,5 +55,25 @@ struct ssd1963_platform_data {
 
 extern void ssd_wr_slow_cmd(u8);
 extern void ssd_wr_slow_data(u8);
+/* returns the byte read or -1 if no #RD line is connected */
+extern int ssd_rd_slow_data(void);
+
+/* Bytes of data a BLIT or WRITE command of h lines of row bytes reads, lines
+ * pitch bytes apart (0: packed). Computed in 64 bits, neither wraps. */
+static inline u64 ssd1963_cmd_data_len(u32 row, u32 pitch, u32 h)
+{
+	return (u64)(pitch ? pitch : row) * (h - 1) + row;
+}
+
+/* Bytes inline data of size takes up in a command buffer, padded to 8, or
+ * -EINVAL if more than the avail left or than fits the return value. */
+static inline int ssd1963_cmd_inline_size(u32 size, u32 avail)
+{
+	u64 n = ((u64)size + 7) & ~(u64)7;
+
+	if (n > avail || n > INT_MAX)
+		return -EINVAL;
+	return n;
+}
 
 #endif
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2013, Franz Brauße
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SSD1963_IOCTL_H
+#define SSD1963_IOCTL_H
+
+/* Driver specific ioctls on the framebuffer device, see ssd1963_fb_ioctl(). */
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* A command buffer is a sequence of struct ssd1963_cmd, each followed by
+ * cmd.size bytes of inline pixel data padded to a multiple of 8 bytes. The
+ * whole buffer is validated before any command is executed. Coordinates are
+ * those of the framebuffer's virtual resolution. */
+enum ssd1963_cmd_op {
+	SSD1963_CMD_FILL,  /* w x h pixels of color fg */
+	SSD1963_CMD_BLIT,  /* w x h pixels of data in format fmt */
+	SSD1963_CMD_COPY,  /* w x h pixels from sx, sy */
+	SSD1963_CMD_WRITE, /* w x h pixels of data in the framebuffer's format */
+};
+
+enum ssd1963_cmd_fmt {
+	SSD1963_FMT_MONO,     /* 1 bpp, MSB first, set bits fg, others bg */
+	SSD1963_FMT_RGB565,   /* u16 */
+	SSD1963_FMT_BGR888,   /* bytes B, G, R */
+	SSD1963_FMT_XRGB8888, /* u32 */
+};
+
+/* the pixel data is at user address data instead of following the command */
+#define SSD1963_CMD_F_REF	0x0001
+
+struct ssd1963_cmd {
+	__u8 op;      /* enum ssd1963_cmd_op */
+	__u8 fmt;     /* enum ssd1963_cmd_fmt, BLIT only */
+	__u16 flags;  /* SSD1963_CMD_F_* */
+	__u16 x, y, w, h;
+	__u16 sx, sy; /* COPY only */
+	__u32 fg, bg; /* 0xRRGGBB, or palette indices in modes up to 8 bpp */
+	__u32 pitch;  /* bytes from one line of data to the next, 0: packed */
+	__u32 size;   /* bytes of inline data, 0 with SSD1963_CMD_F_REF */
+	__u64 data;   /* user address of the data with SSD1963_CMD_F_REF */
+};
+
+struct ssd1963_cmdbuf {
+	__u64 cmds;   /* user address of the command buffer */
+	__u32 size;   /* its length in bytes */
+	__u32 seq;    /* returned, see SSD1963_IOC_WAIT */
+};
+
+/* Waits until everything drawn by the command buffer with sequence number seq
+ * and before it was sent to the controller. Returns 0 then, or fails with
+ * EAGAIN if timeout_ms is 0 and it wasn't sent yet, ETIMEDOUT or EINTR. The
+ * framebuffer's other ioctls are held off while waiting, so a call waits for
+ * SSD1963_WAIT_MAX_MS at most: with a longer timeout_ms it then fails with
+ * EAGAIN, to be repeated for the remaining time. */
+struct ssd1963_wait {
+	__u32 seq;
+	__u32 timeout_ms; /* SSD1963_WAIT_FOREVER to not time out */
+};
+
+#define SSD1963_WAIT_FOREVER	0xffffffffU
+#define SSD1963_WAIT_MAX_MS	100
+
+#define SSD1963_CMDBUF_MAX	(4 << 20)
+
+/* Sends rects of the mmap()ed framebuffer userspace changed. This is how
+ * changes get to the controller after SSD1963_MMAP_DIRECT, where writes to
+ * the mapping aren't tracked; the rects are sent as they are instead of
+ * being diffed against the last sent frame. Returns a sequence number like
+ * SSD1963_IOC_SUBMIT. */
+struct ssd1963_rect {
+	__u16 x, y, w, h;
+};
+
+struct ssd1963_damage {
+	__u64 rects;  /* user address of n struct ssd1963_rect */
+	__u32 n;
+	__u32 flags;  /* SSD1963_DAMAGE_F_* */
+	__u32 seq;    /* returned */
+	__u32 reserved;
+};
+
+/* wait for the panel's vertical blanking before sending the rects */
+#define SSD1963_DAMAGE_F_VBLANK	0x0001
+/* leave the rects to an interlaced flush, which sends one field of their
+ * lines now and the others with the next flushes, see the interlace module
+ * parameter; without it set, the rects are flushed in full */
+#define SSD1963_DAMAGE_F_INTERLACE	0x0002
+
+#define SSD1963_DAMAGE_MAX	256
+
+/* How mmap()s after this map the framebuffer: through deferred I/O, which
+ * write protects the pages to find changed lines (the default), or
+ * directly, relying on SSD1963_IOC_DAMAGE. The mode is not per open file but
+ * the device's, applying to every process mapping it later, so setting it
+ * needs CAP_SYS_ADMIN. */
+#define SSD1963_MMAP_DEFIO	0
+#define SSD1963_MMAP_DIRECT	1
+
+#define SSD1963_IOC_SUBMIT	_IOWR('F', 0xa0, struct ssd1963_cmdbuf)
+#define SSD1963_IOC_WAIT	_IOW('F', 0xa1, struct ssd1963_wait)
+#define SSD1963_IOC_DAMAGE	_IOWR('F', 0xa2, struct ssd1963_damage)
+#define SSD1963_IOC_MMAP_MODE	_IOW('F', 0xa3, __u32)
+
+#endif
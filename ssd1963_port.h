@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2013, Franz Brauße
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SSD1963_PORT_H
+#define SSD1963_PORT_H
+
+/* What ssd1963.c, ssd1963_cmd.h and ssd1963_bus.h need from their
+ * environment: the kernel's fixed width types, ARRAY_SIZE, msleep,
+ * usleep_range and printk. Outside of the kernel (libssd1963) these are
+ * provided on top of libc. */
+
+#ifdef __KERNEL__
+
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+#include <linux/delay.h>
+
+typedef u8	uint_least8_t;
+typedef u16	uint_least16_t;
+typedef u32	uint_least32_t;
+typedef u64	uint_least64_t;
+
+#define SSD_LOG_NAME	"ssd1963_fb"
+
+#else
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+typedef uint8_t		u8;
+typedef uint16_t	u16;
+typedef uint32_t	u32;
+typedef uint64_t	u64;
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+#define KERN_INFO	""
+#define KERN_DEBUG	""
+#define printk(...)	fprintf(stderr, __VA_ARGS__)
+
+#define SSD_LOG_NAME	"libssd1963"
+
+static inline void usleep_range(unsigned long min, unsigned long max)
+{
+	struct timespec ts = { min / 1000000, min % 1000000 * 1000 };
+
+	(void)max;
+	while (nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+static inline void msleep(unsigned ms)
+{
+	usleep_range(ms * 1000UL, ms * 1000UL);
+}
+
+#endif
+
+#endif
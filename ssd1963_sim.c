@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2013, Franz Brauße
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* A simulated SSD1963 for libssd1963 built with SSD1963_LIB_SIM: the GPIO
+ * register writes of the bus code are decoded into commands and GRAM writes
+ * on the rising edge of #WR. Only addressing (0x2a, 0x2b), memory writes
+ * (0x2c, 0x3c), the interface format (0xf0) and the panel size (0xb0) are
+ * interpreted, the address mode is ignored. Reads return 0 except for
+ * GET_PLL_STATUS, which reports a locked PLL. */
+
+#include <stdio.h>
+
+#include "libssd1963.h"
+
+static struct ssd1963_sim {
+	const struct ssd1963_platform_data *pdata;
+	u32 lev, fsel[6];
+	u8 cmd, n, params[8];
+	u8 rd;                     /* answer to the current command */
+	int writing;               /* after 0x2c or 0x3c */
+	enum ssd_interface_fmt fmt;
+	u16 sc, ec, sp, ep, x, y;
+	u64 acc;                   /* bus words not yet forming a pixel */
+	unsigned nbits;
+	u16 hdp, vdp;
+	u8 log[256];               /* commands since ssd1963_sim_cmds() */
+	unsigned nlog;
+	u32 gram[SSD1963_MAX_WIDTH * SSD1963_MAX_HEIGHT];
+} sim;
+
+void ssd1963_sim_attach(const struct ssd1963_platform_data *pdata)
+{
+	memset(&sim, 0, sizeof(sim));
+	sim.pdata = pdata;
+	sim.hdp = pdata->lcd.hori.visible;
+	sim.vdp = pdata->lcd.vert.visible;
+}
+
+/* bits per bus word and per pixel of the interface formats */
+static const u8 sim_word_bits[] = {
+	[SSD_DATA_8] = 8, [SSD_DATA_12] = 12, [SSD_DATA_16_PACKED] = 16,
+	[SSD_DATA_16_565] = 16, [SSD_DATA_18] = 18, [SSD_DATA_24] = 24,
+	[SSD_DATA_9] = 9,
+};
+
+static const u8 sim_px_bits[] = {
+	[SSD_DATA_8] = 24, [SSD_DATA_12] = 24, [SSD_DATA_16_PACKED] = 24,
+	[SSD_DATA_16_565] = 16, [SSD_DATA_18] = 18, [SSD_DATA_24] = 24,
+	[SSD_DATA_9] = 18,
+};
+
+static u32 sim_xrgb(u32 px, unsigned bits)
+{
+	switch (bits) {
+	case 16:
+		return ((px >> 11 & 0x1f) * 255 / 31) << 16 |
+		       ((px >>  5 & 0x3f) * 255 / 63) <<  8 |
+		       ((px       & 0x1f) * 255 / 31);
+	case 18:
+		return ((px >> 12 & 0x3f) * 255 / 63) << 16 |
+		       ((px >>  6 & 0x3f) * 255 / 63) <<  8 |
+		       ((px       & 0x3f) * 255 / 63);
+	default:
+		return px & 0xffffff;
+	}
+}
+
+static void sim_px(u32 word)
+{
+	unsigned wb = sim_word_bits[sim.fmt], pb = sim_px_bits[sim.fmt];
+	u32 px;
+
+	sim.acc = sim.acc << wb | (word & ((1U << wb) - 1));
+	sim.nbits += wb;
+	while (sim.nbits >= pb) {
+		sim.nbits -= pb;
+		px = sim.acc >> sim.nbits & ((1U << pb) - 1);
+		if (sim.x < SSD1963_MAX_WIDTH && sim.y < SSD1963_MAX_HEIGHT)
+			sim.gram[sim.y * SSD1963_MAX_WIDTH + sim.x] =
+				sim_xrgb(px, pb);
+		if (++sim.x > sim.ec) {
+			sim.x = sim.sc;
+			if (++sim.y > sim.ep)
+				sim.y = sim.sp;
+		}
+	}
+}
+
+static void sim_cmd(u8 cmd)
+{
+	if (sim.nlog < sizeof(sim.log))
+		sim.log[sim.nlog] = cmd;
+	sim.nlog++;
+	sim.cmd = cmd;
+	sim.n = 0;
+	sim.rd = cmd == 0xe4 ? 0x04 : 0; /* GET_PLL_STATUS: locked */
+	sim.writing = cmd == 0x2c || cmd == 0x3c;
+	if (cmd == 0x2c) {
+		sim.x = sim.sc;
+		sim.y = sim.sp;
+		sim.acc = 0;
+		sim.nbits = 0;
+	}
+}
+
+static void sim_data(u32 word)
+{
+	const u8 *p = sim.params;
+
+	if (sim.writing) {
+		sim_px(word);
+		return;
+	}
+	if (sim.n == sizeof(sim.params))
+		return;
+	sim.params[sim.n++] = word;
+
+	switch (sim.cmd) {
+	case 0x2a:
+		if (sim.n == 4) {
+			sim.sc = p[0] << 8 | p[1];
+			sim.ec = p[2] << 8 | p[3];
+		}
+		break;
+	case 0x2b:
+		if (sim.n == 4) {
+			sim.sp = p[0] << 8 | p[1];
+			sim.ep = p[2] << 8 | p[3];
+		}
+		break;
+	case 0xb0:
+		if (sim.n == 6) {
+			sim.hdp = (p[2] << 8 | p[3]) + 1;
+			sim.vdp = (p[4] << 8 | p[5]) + 1;
+		}
+		break;
+	case 0xf0:
+		if (p[0] < ARRAY_SIZE(sim_word_bits))
+			sim.fmt = p[0];
+		break;
+	}
+}
+
+/* the word on the data lines */
+static u32 sim_bus_word(void)
+{
+	const struct ssd1963_platform_data *pdata = sim.pdata;
+	u32 v = 0;
+	unsigned i;
+
+	for (i = 0; i < pdata->bus_width; i++)
+		if (sim.lev & 1 << pdata->data_pins[i])
+			v |= 1 << i;
+	return v;
+}
+
+u32 ssd1963_sim_rd(unsigned reg)
+{
+	if (reg < sizeof(sim.fsel))
+		return sim.fsel[reg / 4];
+	if (reg == SSD_GPIO_LEV0)
+		return sim.lev;
+	return 0;
+}
+
+void ssd1963_sim_wr(unsigned reg, u32 v)
+{
+	const struct ssd1963_platform_data *pdata = sim.pdata;
+	u32 wr = 1 << pdata->wr_pin, old = sim.lev;
+	unsigned i;
+
+	if (reg < sizeof(sim.fsel)) {
+		sim.fsel[reg / 4] = v;
+		return;
+	}
+	if (reg == SSD_GPIO_SET0)
+		sim.lev |= v;
+	else if (reg == SSD_GPIO_CLR0)
+		sim.lev &= ~v;
+	else
+		return;
+
+	/* #RD asserted: the controller drives D0-D7 */
+	if (pdata->rd_pin != SSD1963_PIN_NONE &&
+	    old & ~sim.lev & 1 << pdata->rd_pin) {
+		for (i = 0; i < 8; i++) {
+			sim.lev &= ~(1 << pdata->data_pins[i]);
+			if (sim.rd & 1 << i)
+				sim.lev |= 1 << pdata->data_pins[i];
+		}
+	}
+
+	/* rising #WR latches */
+	if (~old & sim.lev & wr) {
+		if (sim.lev & 1 << pdata->dc_pin)
+			sim_data(sim_bus_word());
+		else
+			sim_cmd(sim_bus_word());
+	}
+}
+
+const u32 * ssd1963_sim_gram(unsigned *w, unsigned *h)
+{
+	*w = sim.hdp;
+	*h = sim.vdp;
+	return sim.gram;
+}
+
+unsigned ssd1963_sim_cmds(u8 *cmds, unsigned max)
+{
+	unsigned n = sim.nlog;
+
+	if (max > n)
+		max = n;
+	if (max > sizeof(sim.log))
+		max = sizeof(sim.log);
+	memcpy(cmds, sim.log, max);
+	sim.nlog = 0;
+	return n;
+}
+
+int ssd1963_sim_dump(const char *path)
+{
+	unsigned x, y;
+	u32 c;
+	FILE *f;
+
+	f = fopen(path, "wb");
+	if (!f)
+		return -errno;
+	fprintf(f, "P6\n%u %u\n255\n", sim.hdp, sim.vdp);
+	for (y = 0; y < sim.vdp && y < SSD1963_MAX_HEIGHT; y++)
+		for (x = 0; x < sim.hdp && x < SSD1963_MAX_WIDTH; x++) {
+			c = sim.gram[y * SSD1963_MAX_WIDTH + x];
+			putc(c >> 16, f);
+			putc(c >> 8, f);
+			putc(c, f);
+		}
+	if (fclose(f))
+		return -errno;
+	return 0;
+}
@@ -0,0 +1,513 @@
+/*
+ * Copyright (c) 2013, Franz Brauße
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* V4L2 output node streaming video frames into the framebuffer. Queued
+ * buffers are converted into the shadow, in the var format and thereby the
+ * bus format's layout, centered on the panel. Their lines are then sent by
+ * the flush, started in the vertical blanking, and a buffer is only returned
+ * once it was sent, which paces streaming to the panel. */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fb.h>
+#include <linux/console.h>
+#include <linux/kthread.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#include <media/v4l2-device.h>
+#include <media/v4l2-dev.h>
+#include <media/v4l2-ioctl.h>
+#include <media/v4l2-fh.h>
+#include <media/videobuf2-core.h>
+#include <media/videobuf2-vmalloc.h>
+
+#include "ssd1963_fb.h"
+#include "ssd1963_v4l2.h"
+
+#define DRIVER_NAME		SSD1963_FB_DRIVER_NAME
+#define MODULE_NAME		DRIVER_NAME
+
+struct ssd1963_v4l2_buf {
+	struct vb2_buffer vb; /* first, see vb2_queue.buf_struct_size */
+	struct list_head list;
+};
+
+struct ssd1963_v4l2 {
+	struct v4l2_device v4l2_dev;
+	struct video_device vdev;
+	struct vb2_queue queue;
+	struct mutex lock;         /* serializes the ioctls */
+	struct v4l2_pix_format pix;
+	int registered;
+
+	spinlock_t qlock;
+	struct list_head queued;   /* qlock, buffers not converted yet */
+	wait_queue_head_t wq;      /* thread waits for buffers */
+	struct task_struct *thread;
+	u32 sequence;
+};
+
+static struct ssd1963_v4l2 this_v4l2;
+
+static const struct ssd1963_v4l2_fmt {
+	u32 fourcc;
+	const char *name;
+	u8 depth;                  /* bits per pixel */
+} ssd1963_v4l2_fmts[] = {
+	{ V4L2_PIX_FMT_YUYV,   "YUYV 4:2:2",   16 },
+	{ V4L2_PIX_FMT_NV12,   "Y/CbCr 4:2:0", 12 },
+	{ V4L2_PIX_FMT_RGB565, "RGB565",       16 },
+	{ V4L2_PIX_FMT_RGB24,  "RGB24",        24 },
+};
+
+static const struct ssd1963_v4l2_fmt * ssd1963_v4l2_find_fmt(u32 fourcc)
+{
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(ssd1963_v4l2_fmts); i++)
+		if (ssd1963_v4l2_fmts[i].fourcc == fourcc)
+			return &ssd1963_v4l2_fmts[i];
+	return NULL;
+}
+
+/* --------------------------------------------------------------------------
+ * conversion
+ * -------------------------------------------------------------------------- */
+
+/* 8 bit per channel RGB to the var format */
+static inline u32 ssd1963_v4l2_pack(const struct fb_var_screeninfo *var, u32 r,
+				    u32 g, u32 b)
+{
+	return (r >> (8 - var->red.length)) << var->red.offset |
+	       (g >> (8 - var->green.length)) << var->green.offset |
+	       (b >> (8 - var->blue.length)) << var->blue.offset;
+}
+
+/* BT.601, limited range */
+static inline u32 ssd1963_v4l2_yuv(const struct fb_var_screeninfo *var, int y,
+				   int u, int v)
+{
+	int c = (y - 16) * 298 + 128, d = u - 128, e = v - 128;
+
+	return ssd1963_v4l2_pack(var,
+		clamp_val((c + 409 * e) >> 8, 0, 255),
+		clamp_val((c - 100 * d - 208 * e) >> 8, 0, 255),
+		clamp_val((c + 516 * d) >> 8, 0, 255));
+}
+
+static inline void ssd1963_v4l2_put(u8 *p, u32 Bpp, u32 px)
+{
+	switch (Bpp) {
+	case 2: *(u16 *)p = px; break;
+	case 3: p[0] = px; p[1] = px >> 8; p[2] = px >> 16; break;
+	default: *(u32 *)p = px; break;
+	}
+}
+
+/* converts the frame src into the framebuffer at x0, y0 */
+static void ssd1963_v4l2_convert(const struct ssd1963_v4l2 *v, const u8 *src,
+				 struct fb_info *info, u32 x0, u32 y0)
+{
+	const struct fb_var_screeninfo *var = &info->var;
+	const struct v4l2_pix_format *pix = &v->pix;
+	u32 Bpp = var->bits_per_pixel / 8, x, y, px;
+	const u8 *s, *uv;
+	u8 *d;
+
+	for (y = 0; y < pix->height; y++) {
+		d = info->screen_base + (y0 + y) * info->fix.line_length +
+		    x0 * Bpp;
+		s = src + y * pix->bytesperline;
+		switch (pix->pixelformat) {
+		case V4L2_PIX_FMT_YUYV:
+			for (x = 0; x < pix->width; x += 2, s += 4) {
+				ssd1963_v4l2_put(d, Bpp,
+					ssd1963_v4l2_yuv(var, s[0], s[1], s[3]));
+				d += Bpp;
+				ssd1963_v4l2_put(d, Bpp,
+					ssd1963_v4l2_yuv(var, s[2], s[1], s[3]));
+				d += Bpp;
+			}
+			break;
+		case V4L2_PIX_FMT_NV12:
+			uv = src + pix->height * pix->bytesperline +
+			     y / 2 * pix->bytesperline;
+			for (x = 0; x < pix->width; x++, d += Bpp)
+				ssd1963_v4l2_put(d, Bpp,
+					ssd1963_v4l2_yuv(var, s[x],
+						uv[x & ~1], uv[x | 1]));
+			break;
+		case V4L2_PIX_FMT_RGB565:
+			for (x = 0; x < pix->width; x++, s += 2, d += Bpp) {
+				px = s[0] | s[1] << 8;
+				ssd1963_v4l2_put(d, Bpp, ssd1963_v4l2_pack(var,
+					(px >> 8 & 0xf8) | px >> 13,
+					(px >> 3 & 0xfc) | (px >> 9 & 0x03),
+					(px << 3 & 0xf8) | (px >> 2 & 0x07)));
+			}
+			break;
+		case V4L2_PIX_FMT_RGB24:
+			for (x = 0; x < pix->width; x++, s += 3, d += Bpp)
+				ssd1963_v4l2_put(d, Bpp, ssd1963_v4l2_pack(var,
+					s[0], s[1], s[2]));
+			break;
+		}
+	}
+}
+
+/* --------------------------------------------------------------------------
+ * streaming
+ * -------------------------------------------------------------------------- */
+
+/* Converts and presents one buffer at a time. Waiting for the flush is
+ * interrupted now and then to notice stop_streaming, e.g. while the panel
+ * is suspended. */
+static int ssd1963_v4l2_thread(void *data)
+{
+	struct ssd1963_v4l2 *v = data;
+	struct fb_info *info = ssd1963_fb_info();
+	struct ssd1963_v4l2_buf *b;
+	unsigned long flags;
+	u32 x0, y0, seq;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(v->wq,
+			!list_empty(&v->queued) || kthread_should_stop());
+
+		spin_lock_irqsave(&v->qlock, flags);
+		b = list_first_entry_or_null(&v->queued,
+					     struct ssd1963_v4l2_buf, list);
+		if (b)
+			list_del(&b->list);
+		spin_unlock_irqrestore(&v->qlock, flags);
+		if (!b)
+			continue;
+
+		/* set_par runs under the console lock, so the mode and the
+		 * shadow's layout stay as checked until presented */
+		console_lock();
+		/* the framebuffer was rotated meanwhile */
+		if (v->pix.width > info->var.xres ||
+		    v->pix.height > info->var.yres) {
+			console_unlock();
+			vb2_buffer_done(&b->vb, VB2_BUF_STATE_ERROR);
+			continue;
+		}
+		x0 = (info->var.xres - v->pix.width) / 2;
+		y0 = (info->var.yres - v->pix.height) / 2;
+		ssd1963_v4l2_convert(v, vb2_plane_vaddr(&b->vb, 0), info,
+				     x0, y0);
+		seq = ssd1963_fb_present(y0, v->pix.height);
+		console_unlock();
+		while (ssd1963_fb_wait(seq, 100) && !kthread_should_stop())
+			;
+
+		b->vb.v4l2_buf.sequence = v->sequence++;
+		/* the time it was shown */
+		v4l2_get_timestamp(&b->vb.v4l2_buf.timestamp);
+		vb2_buffer_done(&b->vb, VB2_BUF_STATE_DONE);
+	}
+	return 0;
+}
+
+static void ssd1963_v4l2_return_bufs(struct ssd1963_v4l2 *v,
+				     enum vb2_buffer_state state)
+{
+	struct ssd1963_v4l2_buf *b, *n;
+	unsigned long flags;
+
+	spin_lock_irqsave(&v->qlock, flags);
+	list_for_each_entry_safe(b, n, &v->queued, list) {
+		list_del(&b->list);
+		vb2_buffer_done(&b->vb, state);
+	}
+	spin_unlock_irqrestore(&v->qlock, flags);
+}
+
+static int ssd1963_v4l2_queue_setup(struct vb2_queue *q,
+				    const struct v4l2_format *fmt,
+				    unsigned *nbuffers, unsigned *nplanes,
+				    unsigned sizes[], void *alloc_ctxs[])
+{
+	struct ssd1963_v4l2 *v = vb2_get_drv_priv(q);
+
+	if (fmt && fmt->fmt.pix.sizeimage < v->pix.sizeimage)
+		return -EINVAL;
+	sizes[0] = fmt ? fmt->fmt.pix.sizeimage : v->pix.sizeimage;
+	*nplanes = 1;
+	if (*nbuffers < 2)
+		*nbuffers = 2;
+	return 0;
+}
+
+static int ssd1963_v4l2_buf_prepare(struct vb2_buffer *vb)
+{
+	struct ssd1963_v4l2 *v = vb2_get_drv_priv(vb->vb2_queue);
+
+	if (vb2_get_plane_payload(vb, 0) < v->pix.sizeimage)
+		return -EINVAL;
+	return 0;
+}
+
+static void ssd1963_v4l2_buf_queue(struct vb2_buffer *vb)
+{
+	struct ssd1963_v4l2 *v = vb2_get_drv_priv(vb->vb2_queue);
+	struct ssd1963_v4l2_buf *b =
+		container_of(vb, struct ssd1963_v4l2_buf, vb);
+	unsigned long flags;
+
+	spin_lock_irqsave(&v->qlock, flags);
+	list_add_tail(&b->list, &v->queued);
+	spin_unlock_irqrestore(&v->qlock, flags);
+	wake_up(&v->wq);
+}
+
+static int ssd1963_v4l2_start_streaming(struct vb2_queue *q, unsigned count)
+{
+	struct ssd1963_v4l2 *v = vb2_get_drv_priv(q);
+	struct fb_info *info = ssd1963_fb_info();
+	int ret = -EBUSY;
+
+	/* no colors to convert to in palette modes, and the format may have
+	 * been set before the framebuffer's resolution changed */
+	if (info->var.bits_per_pixel <= 8 ||
+	    v->pix.width > info->var.xres || v->pix.height > info->var.yres)
+		goto fail;
+
+	v->sequence = 0;
+	v->thread = kthread_run(ssd1963_v4l2_thread, v, DRIVER_NAME "/v4l2");
+	if (!IS_ERR(v->thread))
+		return 0;
+	ret = PTR_ERR(v->thread);
+	v->thread = NULL;
+fail:
+	ssd1963_v4l2_return_bufs(v, VB2_BUF_STATE_QUEUED);
+	return ret;
+}
+
+static void ssd1963_v4l2_stop_streaming(struct vb2_queue *q)
+{
+	struct ssd1963_v4l2 *v = vb2_get_drv_priv(q);
+
+	kthread_stop(v->thread);
+	v->thread = NULL;
+	ssd1963_v4l2_return_bufs(v, VB2_BUF_STATE_ERROR);
+}
+
+static struct vb2_ops ssd1963_v4l2_qops = {
+	.queue_setup     = ssd1963_v4l2_queue_setup,
+	.buf_prepare     = ssd1963_v4l2_buf_prepare,
+	.buf_queue       = ssd1963_v4l2_buf_queue,
+	.start_streaming = ssd1963_v4l2_start_streaming,
+	.stop_streaming  = ssd1963_v4l2_stop_streaming,
+	.wait_prepare    = vb2_ops_wait_prepare,
+	.wait_finish     = vb2_ops_wait_finish,
+};
+
+/* --------------------------------------------------------------------------
+ * ioctls
+ * -------------------------------------------------------------------------- */
+
+static int ssd1963_v4l2_querycap(struct file *file, void *priv,
+				 struct v4l2_capability *cap)
+{
+	strlcpy(cap->driver, DRIVER_NAME, sizeof(cap->driver));
+	strlcpy(cap->card, "SSD1963", sizeof(cap->card));
+	strlcpy(cap->bus_info, "platform:" DRIVER_NAME, sizeof(cap->bus_info));
+	cap->device_caps = V4L2_CAP_VIDEO_OUTPUT | V4L2_CAP_STREAMING;
+	cap->capabilities = cap->device_caps | V4L2_CAP_DEVICE_CAPS;
+	return 0;
+}
+
+static int ssd1963_v4l2_enum_fmt(struct file *file, void *priv,
+				 struct v4l2_fmtdesc *f)
+{
+	if (f->index >= ARRAY_SIZE(ssd1963_v4l2_fmts))
+		return -EINVAL;
+	strlcpy(f->description, ssd1963_v4l2_fmts[f->index].name,
+		sizeof(f->description));
+	f->pixelformat = ssd1963_v4l2_fmts[f->index].fourcc;
+	return 0;
+}
+
+static int ssd1963_v4l2_g_fmt(struct file *file, void *priv,
+			      struct v4l2_format *f)
+{
+	f->fmt.pix = this_v4l2.pix;
+	return 0;
+}
+
+/* frames up to the panel's resolution, even-sized where chroma is shared */
+static int ssd1963_v4l2_try_fmt(struct file *file, void *priv,
+				struct v4l2_format *f)
+{
+	const struct fb_var_screeninfo *var = &ssd1963_fb_info()->var;
+	struct v4l2_pix_format *pix = &f->fmt.pix;
+	const struct ssd1963_v4l2_fmt *fmt;
+
+	fmt = ssd1963_v4l2_find_fmt(pix->pixelformat);
+	if (!fmt)
+		fmt = &ssd1963_v4l2_fmts[0];
+	pix->pixelformat = fmt->fourcc;
+	pix->width = clamp_t(u32, pix->width, 2, var->xres) & ~1;
+	pix->height = clamp_t(u32, pix->height, 2, var->yres);
+	if (fmt->fourcc == V4L2_PIX_FMT_NV12)
+		pix->height &= ~1;
+	pix->field = V4L2_FIELD_NONE;
+	pix->bytesperline = fmt->fourcc == V4L2_PIX_FMT_NV12
+			  ? pix->width : pix->width * fmt->depth / 8;
+	pix->sizeimage = pix->width * pix->height * fmt->depth / 8;
+	pix->colorspace = fmt->fourcc == V4L2_PIX_FMT_YUYV ||
+			  fmt->fourcc == V4L2_PIX_FMT_NV12
+			? V4L2_COLORSPACE_SMPTE170M : V4L2_COLORSPACE_SRGB;
+	pix->priv = 0;
+	return 0;
+}
+
+static int ssd1963_v4l2_s_fmt(struct file *file, void *priv,
+			      struct v4l2_format *f)
+{
+	int ret;
+
+	if (vb2_is_busy(&this_v4l2.queue))
+		return -EBUSY;
+	ret = ssd1963_v4l2_try_fmt(file, priv, f);
+	if (ret)
+		return ret;
+	this_v4l2.pix = f->fmt.pix;
+	return 0;
+}
+
+static const struct v4l2_ioctl_ops ssd1963_v4l2_ioctl_ops = {
+	.vidioc_querycap          = ssd1963_v4l2_querycap,
+	.vidioc_enum_fmt_vid_out  = ssd1963_v4l2_enum_fmt,
+	.vidioc_g_fmt_vid_out     = ssd1963_v4l2_g_fmt,
+	.vidioc_try_fmt_vid_out   = ssd1963_v4l2_try_fmt,
+	.vidioc_s_fmt_vid_out     = ssd1963_v4l2_s_fmt,
+	.vidioc_reqbufs           = vb2_ioctl_reqbufs,
+	.vidioc_create_bufs       = vb2_ioctl_create_bufs,
+	.vidioc_prepare_buf       = vb2_ioctl_prepare_buf,
+	.vidioc_querybuf          = vb2_ioctl_querybuf,
+	.vidioc_qbuf              = vb2_ioctl_qbuf,
+	.vidioc_dqbuf             = vb2_ioctl_dqbuf,
+	.vidioc_expbuf            = vb2_ioctl_expbuf,
+	.vidioc_streamon          = vb2_ioctl_streamon,
+	.vidioc_streamoff         = vb2_ioctl_streamoff,
+};
+
+static const struct v4l2_file_operations ssd1963_v4l2_fops = {
+	.owner          = THIS_MODULE,
+	.open           = v4l2_fh_open,
+	.release        = vb2_fop_release,
+	.poll           = vb2_fop_poll,
+	.mmap           = vb2_fop_mmap,
+	.unlocked_ioctl = video_ioctl2,
+};
+
+/* --------------------------------------------------------------------------
+ * registration
+ * -------------------------------------------------------------------------- */
+
+/* Called after the framebuffer was registered. Buffers are vmalloc()ed, or
+ * imported from userspace memory or a dma-buf, which the thread accesses
+ * through its kernel mapping. */
+int ssd1963_v4l2_register(struct device *dev)
+{
+	struct ssd1963_v4l2 *v = &this_v4l2;
+	struct vb2_queue *q = &v->queue;
+	struct v4l2_format f = {
+		.type = V4L2_BUF_TYPE_VIDEO_OUTPUT,
+		.fmt.pix = {
+			.pixelformat = V4L2_PIX_FMT_YUYV,
+			.width = ~0U,
+			.height = ~0U,
+		},
+	};
+	int ret;
+
+	memset(v, 0, sizeof(*v));
+	mutex_init(&v->lock);
+	spin_lock_init(&v->qlock);
+	INIT_LIST_HEAD(&v->queued);
+	init_waitqueue_head(&v->wq);
+	ssd1963_v4l2_try_fmt(NULL, NULL, &f);
+	v->pix = f.fmt.pix;
+
+	ret = v4l2_device_register(dev, &v->v4l2_dev);
+	if (ret)
+		goto out;
+
+	q->type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	q->io_modes = VB2_MMAP | VB2_USERPTR | VB2_DMABUF;
+	q->drv_priv = v;
+	q->buf_struct_size = sizeof(struct ssd1963_v4l2_buf);
+	q->ops = &ssd1963_v4l2_qops;
+	q->mem_ops = &vb2_vmalloc_memops;
+	q->timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+	q->lock = &v->lock;
+	ret = vb2_queue_init(q);
+	if (ret)
+		goto unregister_v4l2;
+
+	strlcpy(v->vdev.name, "SSD1963 output", sizeof(v->vdev.name));
+	v->vdev.v4l2_dev = &v->v4l2_dev;
+	v->vdev.fops = &ssd1963_v4l2_fops;
+	v->vdev.ioctl_ops = &ssd1963_v4l2_ioctl_ops;
+	v->vdev.release = video_device_release_empty;
+	v->vdev.lock = &v->lock;
+	v->vdev.queue = q;
+	v->vdev.vfl_dir = VFL_DIR_TX;
+	video_set_drvdata(&v->vdev, v);
+	ret = video_register_device(&v->vdev, VFL_TYPE_GRABBER, -1);
+	if (ret)
+		goto unregister_v4l2;
+
+	v->registered = 1;
+	v4l2_info(&v->v4l2_dev, "output on %s\n",
+		  video_device_node_name(&v->vdev));
+	return 0;
+
+unregister_v4l2:
+	v4l2_device_unregister(&v->v4l2_dev);
+out:
+	return ret;
+}
+
+/* before the framebuffer is unregistered */
+void ssd1963_v4l2_unregister(void)
+{
+	struct ssd1963_v4l2 *v = &this_v4l2;
+
+	if (!v->registered)
+		return;
+	video_unregister_device(&v->vdev);
+	v4l2_device_unregister(&v->v4l2_dev);
+	v->registered = 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2013, Franz Brauße
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SSD1963_V4L2_H
+#define SSD1963_V4L2_H
+
+/* V4L2 video output node of the framebuffer driver, see ssd1963_v4l2.c. It
+ * is built when the kernel has videobuf2-vmalloc, which defines
+ * SSD1963_V4L2. */
+
+struct device;
+struct fb_info;
+
+#ifdef SSD1963_V4L2
+extern int ssd1963_v4l2_register(struct device *dev);
+extern void ssd1963_v4l2_unregister(void);
+#else
+static inline int ssd1963_v4l2_register(struct device *dev) { return 0; }
+static inline void ssd1963_v4l2_unregister(void) {}
+#endif
+
+/* provided by ssd1963_fb.c */
+extern struct fb_info * ssd1963_fb_info(void);
+/* sends lines [y,y+h) of the framebuffer, starting in the vertical blanking,
+ * and returns the sequence number completing when they were sent */
+extern u32 ssd1963_fb_present(u32 y, u32 h);
+/* 0 once seq completed, -ETIMEDOUT or -ERESTARTSYS */
+extern int ssd1963_fb_wait(u32 seq, u32 timeout_ms);
+
+#endif
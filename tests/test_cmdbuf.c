@@ -0,0 +1,45 @@
+/* Size checks of SSD1963_IOC_SUBMIT's commands against hostile values. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../ssd1963_fb.h"
+
+static int failed;
+
+#define CHECK(x) \
+	do { \
+		if (!(x)) { \
+			fprintf(stderr, "%s:%d: %s failed\n", \
+				__FILE__, __LINE__, #x); \
+			failed = 1; \
+		} \
+	} while (0)
+
+int main(void)
+{
+	/* padded sizes */
+	CHECK(ssd1963_cmd_inline_size(0, 0) == 0);
+	CHECK(ssd1963_cmd_inline_size(1, 8) == 8);
+	CHECK(ssd1963_cmd_inline_size(8, 8) == 8);
+	CHECK(ssd1963_cmd_inline_size(9, 8) == -EINVAL);
+	CHECK(ssd1963_cmd_inline_size(9, 16) == 16);
+
+	/* ALIGN(size, 8) in 32 bits wraps to 0 for these */
+	CHECK(ssd1963_cmd_inline_size(0xfffffff9, 64) == -EINVAL);
+	CHECK(ssd1963_cmd_inline_size(0xffffffff, 64) == -EINVAL);
+	CHECK(ssd1963_cmd_inline_size(0xfffffff9, 0xffffffff) == -EINVAL);
+	CHECK(ssd1963_cmd_inline_size(0xfffffff8, 0xfffffff8) == -EINVAL);
+
+	/* data lengths */
+	CHECK(ssd1963_cmd_data_len(10, 0, 1) == 10);
+	CHECK(ssd1963_cmd_data_len(10, 0, 3) == 30);
+	CHECK(ssd1963_cmd_data_len(10, 16, 3) == 42);
+	CHECK(ssd1963_cmd_data_len(1, 0xffffffff, 0xffff) ==
+	      0xffffffffULL * 0xfffe + 1);
+
+	if (!failed)
+		printf("test_cmdbuf: ok\n");
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+/* ssd_script_run()'s diffing against the last script run, observed through
+ * the simulated controller. */
+
+#include <stdlib.h>
+
+#include "../libssd1963.h"
+#include "../itdb02.h"
+
+static const struct ssd1963_platform_data pdata = {
+	.lcd		= HSD050IDW1_A,
+	.bus_fmt	= SSD_DATA_8,
+	.xtal_freq	= ITDB02_XTAL_FREQ / 1000,
+	.pll_m		= 40,
+	.pll_n		= 5,
+	.bus_width	= 8,
+	.data_pins	= { 22, 23, 24, 25, 28, 29, 30, 31 },
+	.dc_pin		= 17,
+	.wr_pin		= 18,
+	.rd_pin		= SSD1963_PIN_NONE,
+};
+
+static const struct ssd_bus_ops bus = {
+	.wr_cmd		= ssd_wr_slow_cmd,
+	.wr_data	= ssd_wr_slow_data,
+	.rd_data	= ssd_rd_slow_data,
+};
+
+static int failed;
+
+/* runs s after prev, checks the commands sent were exactly those in want */
+static void check(const char *what, const struct ssd_script *s,
+		  const struct ssd_script *prev, const u8 *want, unsigned n)
+{
+	u8 got[64];
+	unsigned i, m;
+
+	ssd1963_sim_cmds(got, 0);
+	if (ssd_script_run(&bus, s, prev) != SSD_ERR_NONE) {
+		fprintf(stderr, "%s: script failed\n", what);
+		failed = 1;
+		return;
+	}
+	m = ssd1963_sim_cmds(got, sizeof(got));
+	if (m == n && !memcmp(got, want, n))
+		return;
+	fprintf(stderr, "%s: sent", what);
+	for (i = 0; i < m && i < sizeof(got); i++)
+		fprintf(stderr, " %02x", got[i]);
+	fprintf(stderr, ", expected");
+	for (i = 0; i < n; i++)
+		fprintf(stderr, " %02x", want[i]);
+	fprintf(stderr, "\n");
+	failed = 1;
+}
+
+int main(void)
+{
+	struct ssd_script a = { .n = 0 }, b = { .n = 0 };
+	int ret;
+
+	ret = ssd1963_open(&pdata);
+	if (ret) {
+		fprintf(stderr, "ssd1963_open: %d\n", ret);
+		return EXIT_FAILURE;
+	}
+
+	SSD_SCRIPT_CMD(&a, 0, 0, 0xf0, 0x00);
+	SSD_SCRIPT_CMD(&a, 0, 0, 0x2a, 0, 0, 0x03, 0x1f);
+	SSD_SCRIPT_CMD(&a, 0, 0, 0x2b, 0, 0, 0x01, 0xdf);
+	SSD_SCRIPT_CMD(&a, SSD_SCRIPT_ALWAYS, 0, 0x37, 0, 0);
+
+	/* b differs from a in the parameters of 0x2b only */
+	SSD_SCRIPT_CMD(&b, 0, 0, 0xf0, 0x00);
+	SSD_SCRIPT_CMD(&b, 0, 0, 0x2a, 0, 0, 0x03, 0x1f);
+	SSD_SCRIPT_CMD(&b, 0, 0, 0x2b, 0, 0, 0x01, 0x0f);
+	SSD_SCRIPT_CMD(&b, SSD_SCRIPT_ALWAYS, 0, 0x37, 0, 0);
+
+	check("a", &a, NULL, (const u8[]){ 0xf0, 0x2a, 0x2b, 0x37 }, 4);
+	check("a after a", &a, &a, (const u8[]){ 0x37 }, 1);
+	check("b after a", &b, &a, (const u8[]){ 0x2b, 0x37 }, 2);
+
+	/* commands past the end of prev are new */
+	a.n = 2;
+	check("b after 2 of a", &b, &a, (const u8[]){ 0x2b, 0x37 }, 2);
+
+	ssd1963_close();
+	if (!failed)
+		printf("test_script: ok\n");
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}